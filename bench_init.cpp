@@ -0,0 +1,389 @@
+/// Scaling of VarInfo::init on generated programs: sources of the given
+/// number of units are generated, compiled with -g and the binary is
+/// loaded in every mode. Each load runs in a child process so that its
+/// peak RSS is its own. The last mode changes one unit, rebuilds the
+/// binary and times reload(). Results, with the phases of init() (@sa
+/// VarInfo::Stats), are printed as JSON lines, one per (units, mode),
+/// progress goes to stderr. The sources are compiled by
+/// $CC with $CFLAGS (-g -O0 by default).
+///
+/// Usage: bench_init [-u units,...] [-f functions] [-l locals] [-s structs]
+///                   [-n nesting] [-i headers] [-t threads] [-j jobs]
+///                   [-w work dir] [-k]
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "varinfo.hpp"
+
+namespace {
+	struct config_t {
+		config_t() : functions(4), locals(16), structs(8), nesting(3),
+			headers(4), threads(0), jobs(0), work("bench_init.tmp"),
+			keep(false) {};
+
+		std::vector<unsigned> units;
+		unsigned functions;	// per unit
+		unsigned locals;	// per function
+		unsigned structs;	// per header
+		unsigned nesting;	// of structures and of blocks
+		unsigned headers;	// included by every unit
+		unsigned threads;	// @sa VarInfo::Options::threads
+		unsigned jobs;		// compilers run at once
+		std::string work;
+		bool keep;
+	};
+
+	// Variable the loaded binary is checked by.
+	struct probe_t {
+		std::string file;
+		size_t line;
+		std::string name;
+	};
+
+	double seconds_since(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+	}
+
+	std::string absolute(const std::string& path) {
+		if ('/' == path[0])
+			return path;
+		char cwd[4096];
+		return !getcwd(cwd, sizeof(cwd)) ? path : std::string(cwd) + '/' + path;
+	}
+
+	bool write_file(const std::string& path, const std::string& text) {
+		std::ofstream out(path.c_str(), std::ios::binary);
+		out << text;
+		return !!out;
+	}
+
+	std::string struct_name(unsigned header, unsigned s) {
+		return "s" + std::to_string(header) + '_' + std::to_string(s);
+	}
+
+	// Structures of a header nest 'nesting' deep, each has a typedef.
+	std::string generate_header(const config_t& c, unsigned h) {
+		std::ostringstream text;
+		text << "#pragma once\n\n";
+		for (unsigned s = 0; s < c.structs; ++s) {
+			const std::string name = struct_name(h, s);
+			text << "struct " << name << " {\n"
+				<< "\tint id;\n"
+				<< "\tshort flags[4];\n"
+				<< "\tlong key;\n";
+			if (0 != s % c.nesting)
+				text << "\tstruct " << struct_name(h, s - 1) << " inner;\n";
+			text << "\tstruct " << name << " *next;\n"
+				<< "};\n"
+				<< "typedef struct " << name << " t" << name << ";\n\n";
+		}
+		return text.str();
+	}
+
+	// A unit has two globals and functions with locals in nested blocks.
+	std::string generate_unit(const config_t& c, unsigned u, probe_t *probe) {
+		std::ostringstream text;
+		unsigned line = 1;
+		for (unsigned h = 0; h < c.headers; ++h, ++line)
+			text << "#include \"h" << h << ".h\"\n";
+		const std::string type = 't' + struct_name(u % c.headers, u % c.structs);
+		text << "\n" << type << " g" << u << ";\n";
+		line += 1;
+		if (probe) {
+			probe->line = line;
+			probe->name = 'g' + std::to_string(u);
+		}
+		text << "static " << type << " sg" << u << "[4];\n\n";
+		line += 2;
+		for (unsigned f = 0; f < c.functions; ++f) {
+			text << "int f" << u << '_' << f << "(int arg, const " << type << " *p)\n{\n"
+				<< "\tint sum = arg + p->id;\n";
+			unsigned depth = 1;
+			for (unsigned l = 0; l < c.locals; ++l) {
+				const unsigned h = (u + f + l) % c.headers;
+				const unsigned s = (u + l) % c.structs;
+				if (0 == l % 4 && depth < c.nesting) {
+					text << std::string(depth, '\t') << "if (arg > " << l << ") {\n";
+					++depth;
+				}
+				const std::string var = 'v' + std::to_string(l);
+				text << std::string(depth, '\t') << 't' << struct_name(h, s) << ' '
+					<< var << " = {" << l << "};\n"
+					<< std::string(depth, '\t') << "sum += " << var << ".id + "
+					<< var << ".flags[" << l % 4 << "];\n";
+			}
+			while (--depth > 0)
+				text << std::string(depth, '\t') << "}\n";
+			text << "\treturn sum + g" << u << ".id + sg" << u << "[1].id;\n}\n\n";
+		}
+		return text.str();
+	}
+
+	int run(const std::string& command) {
+		const int status = system(command.c_str());
+		return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	}
+
+	// Phases of building a program, in seconds.
+	struct program_t {
+		std::string binary;
+		probe_t probe;
+		double generate;
+		double compile;
+		double link;
+		long size;
+	};
+
+	bool build_program(const config_t& c, unsigned units, program_t& program) {
+		const std::string dir = absolute(c.work) + '/' + std::to_string(units);
+		if (0 != run("rm -rf '" + dir + "' && mkdir -p '" + dir + "'"))
+			return false;
+
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned h = 0; h < c.headers; ++h) {
+			if (!write_file(dir + "/h" + std::to_string(h) + ".h",
+				generate_header(c, h)))
+				return false;
+		}
+		std::ostringstream objects, makefile;
+		for (unsigned u = 0; u < units; ++u) {
+			const std::string name = "u" + std::to_string(u);
+			if (!write_file(dir + '/' + name + ".c",
+				generate_unit(c, u, 0 == u ? &program.probe : 0)))
+				return false;
+			objects << ' ' << name << ".o";
+		}
+		program.probe.file = dir + "/u0.c";
+		if (!write_file(dir + "/main.c", "int main() { return 0; }\n"))
+			return false;
+		makefile << "CFLAGS ?= -g -O0\n"
+			<< "OBJS = main.o" << objects.str() << "\n\n"
+			<< "prog: $(OBJS)\n\t$(CC) -o $@ $(OBJS)\n\n"
+			<< "objs: $(OBJS)\n\n"
+			<< "%.o: %.c\n\t$(CC) $(CFLAGS) -c $< -o $@\n";
+		if (!write_file(dir + "/Makefile", makefile.str()))
+			return false;
+		program.generate = seconds_since(start);
+
+		const std::string make = "make -s -C '" + dir + "' -j" +
+			std::to_string(c.jobs) + ' ';
+		start = std::chrono::steady_clock::now();
+		if (0 != run(make + "objs"))
+			return false;
+		program.compile = seconds_since(start);
+		start = std::chrono::steady_clock::now();
+		if (0 != run(make + "prog"))
+			return false;
+		program.link = seconds_since(start);
+
+		program.binary = dir + "/prog";
+		struct stat st;
+		program.size = 0 == stat(program.binary.c_str(), &st) ? st.st_size : 0;
+		return true;
+	}
+
+	// Times of a load of the binary, measured in a child process.
+	struct sample_t {
+		sample_t() : init(0), query(0), reload(0), ok(false), peak_rss(0) {};
+		double init;
+		double query;	// the first query after init
+		double reload;	// after 'rebuild' (@sa measure)
+		bool ok;
+		long peak_rss;	// KB
+		VarInfo::Stats stats;	// after the first query, or the reload
+	};
+
+	// Runs the 'rebuild' command after the first query and times reload()
+	// if it is given, the variable 'added' must be found after it.
+	bool measure(const program_t& program, const VarInfo::Options& options,
+		sample_t& sample, const std::string& rebuild = std::string(),
+		const probe_t *added = 0) {
+		int fds[2];
+		if (0 != pipe(fds))
+			return false;
+		const pid_t pid = fork();
+		if (pid < 0) {
+			close(fds[0]);
+			close(fds[1]);
+			return false;
+		}
+		if (0 == pid) {
+			close(fds[0]);
+			sample_t s;
+			VarInfo vi;
+			auto start = std::chrono::steady_clock::now();
+			s.ok = vi.init(program.binary, options);
+			s.init = seconds_since(start);
+			start = std::chrono::steady_clock::now();
+			const std::string type = vi.type(program.probe.file,
+				program.probe.line, program.probe.name);
+			s.query = seconds_since(start);
+			s.ok = s.ok && "<Unknown>" != type;
+			if (!rebuild.empty()) {
+				s.ok = s.ok && 0 == run(rebuild);
+				start = std::chrono::steady_clock::now();
+				s.ok = s.ok && vi.reload();
+				s.reload = seconds_since(start);
+				s.ok = s.ok && (!added ||
+					"<Unknown>" != vi.type(added->file, added->line, added->name));
+			}
+			s.stats = vi.stats();
+			const bool written = sizeof(s) == write(fds[1], &s, sizeof(s));
+			_exit(written ? 0 : 1);
+		}
+		close(fds[1]);
+		const bool read_all = sizeof(sample) == read(fds[0], &sample, sizeof(sample));
+		close(fds[0]);
+		int status = 0;
+		struct rusage usage;
+		if (pid != wait4(pid, &status, 0, &usage) || !read_all ||
+			!WIFEXITED(status) || 0 != WEXITSTATUS(status))
+			return false;
+		sample.peak_rss = usage.ru_maxrss;
+		return true;
+	}
+
+	void report(const config_t& c, unsigned units, const program_t& program,
+		const char *mode, unsigned threads, const sample_t& s) {
+		printf("{\"units\": %u, \"functions\": %u, \"locals\": %u, "
+			"\"structs\": %u, \"nesting\": %u, \"headers\": %u, "
+			"\"binary_bytes\": %ld, \"generate_s\": %.6f, \"compile_s\": %.6f, "
+			"\"link_s\": %.6f, \"mode\": \"%s\", \"threads\": %u, "
+			"\"init_s\": %.6f, \"first_query_s\": %.6f, \"open_s\": %.6f, "
+			"\"lines_s\": %.6f, \"dies_s\": %.6f, \"scoping_s\": %.6f, "
+			"\"index_s\": %.6f, \"reload_s\": %.6f, \"fingerprints_s\": %.6f, "
+			"\"units_parsed\": %lu, \"units_reused\": %lu, \"dies\": %lu, "
+			"\"variables\": %lu, \"types\": %lu, \"index_bytes\": %lu, "
+			"\"peak_rss_kb\": %ld, \"ok\": %s}\n",
+			units, c.functions, c.locals, c.structs, c.nesting, c.headers,
+			program.size, program.generate, program.compile, program.link,
+			mode, threads, s.init, s.query, s.stats.open, s.stats.lines,
+			s.stats.dies, s.stats.scoping, s.stats.index, s.reload,
+			s.stats.fingerprints, (unsigned long)s.stats.units,
+			(unsigned long)s.stats.units_reused, (unsigned long)s.stats.dies_visited,
+			(unsigned long)s.stats.variables, (unsigned long)s.stats.types,
+			(unsigned long)s.stats.index_bytes, s.peak_rss, s.ok ? "true" : "false");
+		fflush(stdout);
+	}
+
+	bool parse_units(const char *list, std::vector<unsigned>& units) {
+		std::istringstream in(list);
+		std::string item;
+		while (std::getline(in, item, ',')) {
+			const int n = atoi(item.c_str());
+			if (n <= 0)
+				return false;
+			units.push_back(n);
+		}
+		return !units.empty();
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	config_t c;
+	const char *units = "10,100,1000";
+	for (int opt; -1 != (opt = getopt(argc, argv, "u:f:l:s:n:i:t:j:w:k"));) {
+		switch (opt) {
+		case 'u': units = optarg; break;
+		case 'f': c.functions = atoi(optarg); break;
+		case 'l': c.locals = atoi(optarg); break;
+		case 's': c.structs = atoi(optarg); break;
+		case 'n': c.nesting = atoi(optarg); break;
+		case 'i': c.headers = atoi(optarg); break;
+		case 't': c.threads = atoi(optarg); break;
+		case 'j': c.jobs = atoi(optarg); break;
+		case 'w': c.work = optarg; break;
+		case 'k': c.keep = true; break;
+		default:
+			fprintf(stderr, "Usage: %s [-u units,...] [-f functions] [-l locals] "
+				"[-s structs] [-n nesting] [-i headers] [-t threads] [-j jobs] "
+				"[-w work dir] [-k]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!parse_units(units, c.units) || 0 == c.structs || 0 == c.nesting ||
+		0 == c.headers) {
+		fprintf(stderr, "Bad arguments\n");
+		return 1;
+	}
+	const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	if (0 == c.jobs)
+		c.jobs = cores;
+	const unsigned threads = 0 == c.threads ? cores : c.threads;
+
+	for (size_t i = 0; i < c.units.size(); ++i) {
+		const unsigned n = c.units[i];
+		fprintf(stderr, "%u units: building\n", n);
+		program_t program;
+		if (!build_program(c, n, program)) {
+			fprintf(stderr, "%u units: failed to build the program\n", n);
+			return 1;
+		}
+
+		VarInfo::Options options;
+		options.stats = true;
+		std::vector<std::pair<const char*, VarInfo::Options> > modes;
+		modes.push_back(std::make_pair("eager", options));
+		options.threads = threads;
+		if (threads > 1)
+			modes.push_back(std::make_pair("eager", options));
+		options.lazy = true;
+		modes.push_back(std::make_pair("lazy", options));
+		options.lazy = false;
+		options.native = true;
+		modes.push_back(std::make_pair("native", options));
+		options.native = false;
+		options.cache_dir = absolute(c.work) + '/' + std::to_string(n);
+		modes.push_back(std::make_pair("cache_build", options));
+		modes.push_back(std::make_pair("cache_open", options));
+		options.cache_dir.clear();
+		options.native = true;
+		options.incremental = true;
+		modes.push_back(std::make_pair("reload", options));
+
+		// A global appended to the last unit, the others keep their code
+		// and data addresses.
+		const std::string dir = absolute(c.work) + '/' + std::to_string(n);
+		probe_t added;
+		added.file = dir + "/u" + std::to_string(n - 1) + ".c";
+		added.line = 1;
+		added.name = "reload_probe";
+		{
+			std::ifstream in(added.file.c_str());
+			for (std::string line; std::getline(in, line); ++added.line);
+		}
+		const std::string rebuild = "echo 'int " + added.name + " = 1;' >> '" +
+			added.file + "' && make -s -C '" + dir + "' prog";
+		for (size_t m = 0; m < modes.size(); ++m) {
+			fprintf(stderr, "%u units: %s\n", n, modes[m].first);
+			sample_t s;
+			const bool reload = modes[m].second.incremental;
+			if (!measure(program, modes[m].second, s,
+				reload ? rebuild : std::string(), reload ? &added : 0)) {
+				fprintf(stderr, "%u units: %s failed\n", n, modes[m].first);
+				return 1;
+			}
+			report(c, n, program, modes[m].first, modes[m].second.threads, s);
+		}
+		if (!c.keep)
+			run("rm -rf '" + absolute(c.work) + '/' + std::to_string(n) + "'");
+	}
+	if (!c.keep)
+		rmdir(c.work.c_str());
+	return 0;
+}
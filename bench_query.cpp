@@ -0,0 +1,508 @@
+/// Latency of type() and fieldname() queries on a loaded VarInfo. A query
+/// stream is either replayed from a file or generated along with a C
+/// program (compiled by $CC with $CFLAGS, -g -O0 by default) that has
+/// globals, locals in nested blocks, parameters, arrays and typedef chains;
+/// the stream mixes hits and misses. Throughput and latency percentiles
+/// are printed as JSON lines, one per (threads, kind). Given a baseline
+/// (a saved output) the results are compared to it and the exit code is 2
+/// if any of them is worse by more than the tolerance.
+///
+/// Usage: bench_query [-p binary -q queries] [-o queries out] [-u units]
+///                    [-d typedef depth] [-n stream length] [-t threads,...]
+///                    [-r repetitions] [-s save baseline] [-b baseline]
+///                    [-x tolerance %] [-w work dir] [-L]
+///
+/// Queries file lines: "T <file> <line> <name>" for type() and
+/// "F <file> <line> <name> <offset>" for fieldname().
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "varinfo.hpp"
+
+namespace {
+	struct query_t {
+		bool field;		// fieldname() or type()
+		std::string file;
+		size_t line;
+		std::string name;
+		unsigned offset;
+	};
+	typedef std::vector<query_t> Queries_t;
+
+	// Summary of a run, as saved in the baseline.
+	struct result_t {
+		unsigned threads;
+		std::string kind;	// "type", "field" or "all"
+		size_t queries;
+		size_t hits;
+		double qps;
+		double p50, p90, p99, max;	// ns
+	};
+
+	std::string absolute(const std::string& path) {
+		if ('/' == path[0])
+			return path;
+		char cwd[4096];
+		return !getcwd(cwd, sizeof(cwd)) ? path : std::string(cwd) + '/' + path;
+	}
+
+	int run(const std::string& command) {
+		const int status = system(command.c_str());
+		return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	}
+
+	// Source text that counts its lines.
+	class source_t {
+	public:
+		source_t() : _line(0) {};
+		size_t line(const std::string& text) {
+			_text << text << '\n';
+			return ++_line;
+		}
+		std::string str() const { return _text.str(); }
+	private:
+		std::ostringstream _text;
+		size_t _line;
+	};
+
+	// Queries to a generated unit, by the kind of the variable.
+	struct pool_t {
+		Queries_t globals, locals, params, fields, misses;
+	};
+
+	void add(Queries_t& queries, bool field, const std::string& file,
+		size_t line, const std::string& name, unsigned offset = 0) {
+		query_t q;
+		q.field = field;
+		q.file = file;
+		q.line = line;
+		q.name = name;
+		q.offset = offset;
+		queries.push_back(q);
+	}
+
+	// Common header: a structure with arrays and a chain of typedefs.
+	std::string generate_header(unsigned depth) {
+		std::ostringstream text;
+		text << "#pragma once\n\n"
+			<< "typedef struct point { int x; int y; } point_t;\n"
+			<< "struct rec {\n\tint id;\n\tshort flags[4];\n\tpoint_t pts[3];\n"
+			<< "\tstruct rec *next;\n};\n"
+			<< "typedef struct rec t0;\n";
+		for (unsigned d = 1; d <= depth; ++d)
+			text << "typedef t" << d - 1 << " t" << d << ";\n";
+		return text.str();
+	}
+
+	std::string generate_unit(unsigned u, unsigned depth,
+		const std::string& file, pool_t& pool) {
+		const std::string deep = 't' + std::to_string(depth);
+		const std::string g = "g" + std::to_string(u);
+		source_t text;
+		text.line("#include \"common.h\"");
+		const size_t first = text.line("struct rec " + g + "[8];");
+		const size_t second = text.line("static " + deep + " s" + g + ";");
+		text.line("");
+		for (unsigned f = 0; f < 8; ++f) {
+			const std::string fn = "f" + std::to_string(u) + '_' + std::to_string(f);
+			text.line("int " + fn + "(int a, struct rec *r, " + deep + " q)");
+			const size_t open = text.line("{");
+			// No braces of initializers, they would be taken for scopes.
+			const size_t v = text.line("\tstruct rec v;");
+			const size_t t = text.line("\t" + deep + " t = q;");
+			const size_t arr = text.line("\tint arr[16];");
+			text.line("\tv.id = arr[a & 15] = a;");
+			text.line("\tif (a > 1) {");
+			const size_t inner = text.line("\t\tpoint_t p;");
+			text.line("\t\tp.x = p.y = a;");
+			text.line("\t\tv.pts[1] = p;");
+			const size_t inner_end = text.line("\t}");
+			text.line("\treturn v.id + t.id + arr[a & 15] + r->id + " + g +
+				"[a & 7].id + s" + g + ".id;");
+			text.line("}");
+			text.line("");
+
+			add(pool.params, false, file, open + 1, "a");
+			add(pool.params, false, file, v + 1, "r");
+			add(pool.params, true, file, t + 1, "q", 4 + f % 8);	// flags
+			add(pool.locals, false, file, v + 1, "v");
+			add(pool.locals, false, file, t + 1, "t");
+			add(pool.locals, false, file, inner + 1, "p");
+			add(pool.fields, true, file, arr + 1, "v", 12 + 8 * (f % 3) + 4);	// pts[i].y
+			add(pool.fields, true, file, arr + 1, "t", 2 * f);
+			add(pool.fields, true, file, arr + 1, "arr", 4 * f);
+			add(pool.fields, true, file, inner + 1, "p", f % 8);
+			add(pool.misses, false, file, inner_end + 2, "p");	// out of scope
+			add(pool.misses, false, file, v, "nosuch");
+			add(pool.misses, true, file + ".none", v + 1, "v", 0);
+		}
+		add(pool.globals, false, file, second + 1, g);
+		add(pool.globals, false, file, second + 1, "s" + g);
+		for (unsigned o = 0; o < 8 * 48; o += 20)
+			add(pool.fields, true, file, first + 1, g, o);
+		return text.str();
+	}
+
+	bool generate(const std::string& work, unsigned units, unsigned depth,
+		std::string& binary, pool_t& pool) {
+		const std::string dir = absolute(work);
+		if (0 != run("rm -rf '" + dir + "' && mkdir -p '" + dir + "'"))
+			return false;
+		std::ofstream(dir + "/common.h") << generate_header(depth);
+		std::ostringstream objects;
+		for (unsigned u = 0; u < units; ++u) {
+			const std::string name = "u" + std::to_string(u);
+			const std::string file = dir + '/' + name + ".c";
+			std::ofstream(file.c_str()) << generate_unit(u, depth, file, pool);
+			objects << ' ' << name << ".o";
+		}
+		std::ofstream(dir + "/main.c") << "int main() { return 0; }\n";
+		std::ofstream(dir + "/Makefile") << "CFLAGS ?= -g -O0\n"
+			<< "OBJS = main.o" << objects.str() << "\n\n"
+			<< "prog: $(OBJS)\n\t$(CC) -o $@ $(OBJS)\n\n"
+			<< "%.o: %.c\n\t$(CC) $(CFLAGS) -c $< -o $@\n";
+		const unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+		if (0 != run("make -s -C '" + dir + "' -j" + std::to_string(jobs)))
+			return false;
+		binary = dir + "/prog";
+		return true;
+	}
+
+	// Picks 'count' queries: 30% fields, 25% locals, 20% parameters,
+	// 10% globals and 15% misses.
+	Queries_t mix(const pool_t& pool, size_t count) {
+		const Queries_t *const kinds[] = {&pool.fields, &pool.locals,
+			&pool.params, &pool.globals, &pool.misses};
+		const unsigned weights[] = {30, 25, 20, 10, 15};
+		Queries_t queries;
+		queries.reserve(count);
+		unsigned seed = 1;
+		for (size_t i = 0; i < count; ++i) {
+			seed = seed * 1103515245 + 12345;
+			unsigned r = (seed >> 16) % 100, k = 0;
+			while (r >= weights[k])
+				r -= weights[k++];
+			seed = seed * 1103515245 + 12345;
+			const Queries_t& q = *kinds[k];
+			queries.push_back(q[(seed >> 8) % q.size()]);
+		}
+		return queries;
+	}
+
+	bool read_queries(const std::string& path, Queries_t& queries) {
+		std::ifstream in(path.c_str());
+		std::string line;
+		while (std::getline(in, line)) {
+			std::istringstream fields(line);
+			std::string kind;
+			query_t q;
+			q.offset = 0;
+			if (!(fields >> kind >> q.file >> q.line >> q.name))
+				continue;
+			q.field = "F" == kind;
+			if (q.field && !(fields >> q.offset))
+				return false;
+			queries.push_back(q);
+		}
+		return !queries.empty();
+	}
+
+	bool write_queries(const std::string& path, const Queries_t& queries) {
+		std::ofstream out(path.c_str());
+		for (auto q = queries.begin(); queries.end() != q; ++q) {
+			out << (q->field ? "F " : "T ") << q->file << ' ' << q->line << ' ' << q->name;
+			if (q->field)
+				out << ' ' << q->offset;
+			out << '\n';
+		}
+		return !!out;
+	}
+
+	// Latencies of the queries of one thread, in ns.
+	struct samples_t {
+		std::vector<uint32_t> type, field;
+		size_t type_hits, field_hits;
+	};
+
+	void replay(const VarInfo& vi, const Queries_t& queries, size_t first,
+		unsigned reps, samples_t& s) {
+		s.type_hits = s.field_hits = 0;
+		s.type.reserve(reps * queries.size());
+		s.field.reserve(reps * queries.size());
+		for (unsigned r = 0; r < reps; ++r) {
+			for (size_t i = 0; i < queries.size(); ++i) {
+				const query_t& q = queries[(first + i) % queries.size()];
+				const auto start = std::chrono::steady_clock::now();
+				const std::string answer = q.field ?
+					vi.fieldname(q.file, q.line, q.name, q.offset) :
+					vi.type(q.file, q.line, q.name);
+				const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now() - start).count();
+				const bool hit = "<Unknown>" != answer;
+				if (q.field) {
+					s.field.push_back(ns);
+					s.field_hits += hit;
+				} else {
+					s.type.push_back(ns);
+					s.type_hits += hit;
+				}
+			}
+		}
+	}
+
+	result_t summarize(unsigned threads, const char *kind,
+		std::vector<uint32_t>& ns, size_t hits, double seconds) {
+		result_t r;
+		r.threads = threads;
+		r.kind = kind;
+		r.queries = ns.size();
+		r.hits = hits;
+		r.qps = ns.size() / std::max(seconds, 1e-9);
+		r.p50 = r.p90 = r.p99 = r.max = 0;
+		if (!ns.empty()) {
+			std::sort(ns.begin(), ns.end());
+			r.p50 = ns[ns.size() / 2];
+			r.p90 = ns[ns.size() * 90 / 100];
+			r.p99 = ns[ns.size() * 99 / 100];
+			r.max = ns.back();
+		}
+		return r;
+	}
+
+	// Runs the stream on 'threads' threads at once, each starting at
+	// another place of the stream.
+	void measure(const VarInfo& vi, const Queries_t& queries, unsigned threads,
+		unsigned reps, std::vector<result_t>& results) {
+		std::vector<samples_t> samples(threads);
+		std::vector<std::thread> workers;
+		const auto start = std::chrono::steady_clock::now();
+		for (unsigned t = 0; t < threads; ++t) {
+			workers.push_back(std::thread(replay, std::cref(vi), std::cref(queries),
+				t * queries.size() / threads, reps, std::ref(samples[t])));
+		}
+		for (auto w = workers.begin(); workers.end() != w; ++w)
+			w->join();
+		const double seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+
+		std::vector<uint32_t> type, field, all;
+		size_t type_hits = 0, field_hits = 0;
+		for (auto s = samples.begin(); samples.end() != s; ++s) {
+			type.insert(type.end(), s->type.begin(), s->type.end());
+			field.insert(field.end(), s->field.begin(), s->field.end());
+			type_hits += s->type_hits;
+			field_hits += s->field_hits;
+		}
+		all = type;
+		all.insert(all.end(), field.begin(), field.end());
+		// Throughput of a kind is its share of the mixed run.
+		results.push_back(summarize(threads, "type", type, type_hits,
+			seconds * type.size() / std::max<size_t>(all.size(), 1)));
+		results.push_back(summarize(threads, "field", field, field_hits,
+			seconds * field.size() / std::max<size_t>(all.size(), 1)));
+		results.push_back(summarize(threads, "all", all, type_hits + field_hits,
+			seconds));
+	}
+
+	std::string format(const result_t& r) {
+		char line[512];
+		snprintf(line, sizeof(line), "{\"threads\": %u, \"kind\": \"%s\", "
+			"\"queries\": %lu, \"hits\": %lu, \"qps\": %.0f, \"p50_ns\": %.0f, "
+			"\"p90_ns\": %.0f, \"p99_ns\": %.0f, \"max_ns\": %.0f}",
+			r.threads, r.kind.c_str(), (unsigned long)r.queries,
+			(unsigned long)r.hits, r.qps, r.p50, r.p90, r.p99, r.max);
+		return line;
+	}
+
+	double number(const std::string& line, const char *key) {
+		const size_t at = line.find(std::string("\"") + key + "\": ");
+		return std::string::npos == at ? 0 :
+			strtod(line.c_str() + at + strlen(key) + 4, 0);
+	}
+
+	std::string text(const std::string& line, const char *key) {
+		const size_t at = line.find(std::string("\"") + key + "\": \"");
+		if (std::string::npos == at)
+			return std::string();
+		const size_t begin = at + strlen(key) + 5;
+		return line.substr(begin, line.find('"', begin) - begin);
+	}
+
+	bool read_baseline(const std::string& path, std::vector<result_t>& results) {
+		std::ifstream in(path.c_str());
+		std::string line;
+		while (std::getline(in, line)) {
+			result_t r;
+			r.kind = text(line, "kind");
+			if (r.kind.empty())
+				continue;
+			r.threads = number(line, "threads");
+			r.queries = number(line, "queries");
+			r.hits = number(line, "hits");
+			r.qps = number(line, "qps");
+			r.p50 = number(line, "p50_ns");
+			r.p90 = number(line, "p90_ns");
+			r.p99 = number(line, "p99_ns");
+			r.max = number(line, "max_ns");
+			results.push_back(r);
+		}
+		return !results.empty();
+	}
+
+	// Compares throughput and p50/p99 with the baseline, the latencies
+	// below 'floor' ns are too close to the clock resolution to compare.
+	bool compare(const std::vector<result_t>& results,
+		const std::vector<result_t>& baseline, double tolerance) {
+		const double floor = 100;
+		bool ok = true;
+		for (auto r = results.begin(); results.end() != r; ++r) {
+			auto b = baseline.begin();
+			while (baseline.end() != b && (b->threads != r->threads || b->kind != r->kind))
+				++b;
+			if (baseline.end() == b)
+				continue;
+			const double qps = r->qps / std::max(b->qps, 1.0);
+			const double p50 = std::max(r->p50, floor) / std::max(b->p50, floor);
+			const double p99 = std::max(r->p99, floor) / std::max(b->p99, floor);
+			bool worse = qps < 1 - tolerance || p50 > 1 + tolerance ||
+				p99 > 1 + tolerance;
+			fprintf(stderr, "%-3u %-5s qps %+6.1f%%  p50 %+6.1f%%  p99 %+6.1f%%%s\n",
+				r->threads, r->kind.c_str(), 100 * (qps - 1), 100 * (p50 - 1),
+				100 * (p99 - 1), worse ? "  REGRESSION" : "");
+			if (r->hits != b->hits && r->queries == b->queries) {
+				fprintf(stderr, "%-3u %-5s hits %lu, baseline %lu\n", r->threads,
+					r->kind.c_str(), (unsigned long)r->hits, (unsigned long)b->hits);
+				worse = true;
+			}
+			ok = ok && !worse;
+		}
+		return ok;
+	}
+
+	bool parse_list(const char *list, std::vector<unsigned>& values) {
+		std::istringstream in(list);
+		std::string item;
+		while (std::getline(in, item, ',')) {
+			const int n = atoi(item.c_str());
+			if (n <= 0)
+				return false;
+			values.push_back(n);
+		}
+		return !values.empty();
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	std::string binary, queries_in, queries_out, save, baseline;
+	std::string work = "bench_query.tmp";
+	unsigned units = 16, depth = 8, reps = 3;
+	size_t length = 100000;
+	double tolerance = 0.1;
+	bool lazy = false;
+	const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned> threads;
+	for (int opt; -1 != (opt = getopt(argc, argv, "p:q:o:u:d:n:t:r:s:b:x:w:L"));) {
+		switch (opt) {
+		case 'p': binary = optarg; break;
+		case 'q': queries_in = optarg; break;
+		case 'o': queries_out = optarg; break;
+		case 'u': units = atoi(optarg); break;
+		case 'd': depth = atoi(optarg); break;
+		case 'n': length = atol(optarg); break;
+		case 't':
+			if (!parse_list(optarg, threads))
+				threads.clear();
+			break;
+		case 'r': reps = atoi(optarg); break;
+		case 's': save = optarg; break;
+		case 'b': baseline = optarg; break;
+		case 'x': tolerance = atof(optarg) / 100; break;
+		case 'w': work = optarg; break;
+		case 'L': lazy = true; break;
+		default:
+			fprintf(stderr, "Usage: %s [-p binary -q queries] [-o queries out] "
+				"[-u units] [-d typedef depth] [-n stream length] [-t threads,...] "
+				"[-r repetitions] [-s save baseline] [-b baseline] "
+				"[-x tolerance %%] [-w work dir] [-L]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (threads.empty()) {
+		threads.push_back(1);
+		if (cores > 1)
+			threads.push_back(cores);
+	}
+	if (binary.empty() != queries_in.empty() || 0 == units || 0 == reps) {
+		fprintf(stderr, "Bad arguments\n");
+		return 1;
+	}
+
+	Queries_t queries;
+	if (!queries_in.empty()) {
+		if (!read_queries(queries_in, queries)) {
+			fprintf(stderr, "Failed to read queries from %s\n", queries_in.c_str());
+			return 1;
+		}
+	} else {
+		fprintf(stderr, "Generating %u units\n", units);
+		pool_t pool;
+		if (!generate(work, units, depth, binary, pool)) {
+			fprintf(stderr, "Failed to build the program\n");
+			return 1;
+		}
+		queries = mix(pool, length);
+	}
+	if (!queries_out.empty() && !write_queries(queries_out, queries)) {
+		fprintf(stderr, "Failed to write queries to %s\n", queries_out.c_str());
+		return 1;
+	}
+
+	VarInfo vi;
+	VarInfo::Options options;
+	options.threads = 0;
+	options.lazy = lazy;
+	if (!vi.init(binary, options)) {
+		fprintf(stderr, "Failed to load %s\n", binary.c_str());
+		return 1;
+	}
+	// Warm up: loads the units in the lazy mode, faults the pages in.
+	samples_t warm;
+	replay(vi, queries, 0, 1, warm);
+
+	std::vector<result_t> results;
+	for (size_t t = 0; t < threads.size(); ++t)
+		measure(vi, queries, threads[t], reps, results);
+	std::ofstream saved;
+	if (!save.empty())
+		saved.open(save.c_str());
+	for (auto r = results.begin(); results.end() != r; ++r) {
+		printf("%s\n", format(*r).c_str());
+		if (saved.is_open())
+			saved << format(*r) << '\n';
+	}
+	if (queries_in.empty())
+		run("rm -rf '" + absolute(work) + "'");
+
+	if (!baseline.empty()) {
+		std::vector<result_t> base;
+		if (!read_baseline(baseline, base)) {
+			fprintf(stderr, "Failed to read the baseline %s\n", baseline.c_str());
+			return 1;
+		}
+		if (!compare(results, base, tolerance))
+			return 2;
+	}
+	return 0;
+}
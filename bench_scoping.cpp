@@ -0,0 +1,102 @@
+/// Throughput of the scopes parser on generated C++ like sources.
+///
+/// Usage: bench_scoping [size in MB] [repetitions]
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+#include <fstream>
+
+#include "scoping.h"
+
+namespace {
+	// Generates functions with nested blocks, about 'size' bytes.
+	std::string generate(size_t size) {
+		std::string text;
+		text.reserve(size + 1024);
+		unsigned seed = 1;
+		for (int f = 0; text.size() < size; ++f) {
+			text += "int function_" + std::to_string(f) + "(int x, char *p)\n{\n";
+			int depth = 1;
+			for (int s = 0; s < 40; ++s) {
+				seed = seed * 1103515245 + 12345;
+				const unsigned r = (seed >> 16) % 8;
+				text.append(depth, '\t');
+				if (0 == r && depth < 6) {
+					text += "if (x > " + std::to_string(s) + ") {\n";
+					++depth;
+				} else if (1 == r && depth > 1) {
+					text += "}\n";
+					--depth;
+				} else {
+					text += "long variable_" + std::to_string(s) + " = x * "
+						+ std::to_string(seed % 1000) + "; // some comment\n";
+				}
+			}
+			while (depth-- > 0) {
+				text.append(depth, '\t');
+				text += "}\n";
+			}
+			text += "\n";
+		}
+		return text;
+	}
+
+	double seconds_since(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	const size_t mb = argc > 1 ? atoi(argv[1]) : 64;
+	const int reps = argc > 2 ? atoi(argv[2]) : 5;
+	const std::string text = generate(mb << 20);
+	const double size_mb = text.size() / double(1 << 20);
+
+	static const char *const names[] = {"scalar", "sse2", "avx2", "best"};
+	scoping::scope_t reference;
+	scoping::parse(text.data(), text.size(), reference, scoping::SCAN_SCALAR);
+	for (int scan = scoping::SCAN_SCALAR; scan <= scoping::SCAN_BEST; ++scan) {
+		if (!scoping::supported(scoping::scan_t(scan))) {
+			printf("%-8s unsupported\n", names[scan]);
+			continue;
+		}
+		double best = 0;
+		for (int r = 0; r < reps; ++r) {
+			scoping::scope_t scopes;
+			const auto start = std::chrono::steady_clock::now();
+			scoping::parse(text.data(), text.size(), scopes, scoping::scan_t(scan));
+			const double s = seconds_since(start);
+			if (0 == r || s < best)
+				best = s;
+			if (scopes != reference) {
+				printf("%-8s differs from scalar\n", names[scan]);
+				return 1;
+			}
+		}
+		printf("%-8s %8.1f MB/s (%.1f MB, %lu scopes)\n", names[scan],
+			size_mb / best, size_mb, (unsigned long)reference.size());
+	}
+
+	// The whole way from a file: mapping and parsing.
+	const std::string path = "bench_scoping.tmp.cpp";
+	{
+		std::ofstream out(path.c_str(), std::ios::binary);
+		out << text;
+	}
+	double best = 0;
+	for (int r = 0; r < reps; ++r) {
+		scoping::cache cache;
+		const auto start = std::chrono::steady_clock::now();
+		cache.get(path);
+		const double s = seconds_since(start);
+		if (0 == r || s < best)
+			best = s;
+	}
+	remove(path.c_str());
+	printf("%-8s %8.1f MB/s\n", "file", size_mb / best);
+	return 0;
+}
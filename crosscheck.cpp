@@ -0,0 +1,309 @@
+/// Cross-check of the built-in DWARF reader against libdwarf: each binary
+/// is loaded twice, with VarInfo::Options::native set and not, and the
+/// answers of type() and fieldname() for every line of the source and
+/// every variable of sample.h, of symbolize() for the data objects of the
+/// symbol table, as well as the counts of stats(), must be the same.
+/// Makefile.crosscheck builds sample.cpp with DWARF 4, DWARF 5 and type
+/// units, and with clang, which locates variables by DW_OP_addrx. Either
+/// way a reload() of the binary as it is must keep all the units (@sa
+/// VarInfo::Options::incremental).
+///
+/// With -r a binary is reloaded once rebuilt with sample.cpp changed, a
+/// unit of sample_unit.cpp dropped and another one added, in the eager,
+/// incremental and lazy modes with both readers, and must answer the
+/// same as the rebuilt binary loaded anew.
+///
+/// Usage: crosscheck <source> <binary>...
+///        crosscheck -r <before> <after> <source>...
+///
+/// The exit code is 1 if the answers differ.
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <gelf.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "varinfo.hpp"
+#include "sample.h"
+
+namespace {
+	enum {MAX_OFFSET = 64, MAX_REPORTS = 10};
+
+	size_t count_lines(const char *path) {
+		std::ifstream in(path);
+		std::string line;
+		size_t lines = 0;
+		while (std::getline(in, line))
+			++lines;
+		return lines;
+	}
+
+	// Two answers to the same query, named by 'sides'.
+	bool same(const char *binary, const char *what, const std::string& one,
+		const std::string& other, size_t& differences,
+		const char *const sides[2]) {
+		if (one == other)
+			return true;
+		if (differences++ < MAX_REPORTS)
+			fprintf(stderr, "%s: %s: %s \"%s\", %s \"%s\"\n", binary, what,
+				sides[0], one.c_str(), sides[1], other.c_str());
+		return false;
+	}
+
+	bool same(const char *binary, const char *what, const size_t one,
+		const size_t other, size_t& differences, const char *const sides[2]) {
+		return same(binary, what, std::to_string(one),
+			std::to_string(other), differences, sides);
+	}
+
+	const char *const readers[2] = {"native", "libdwarf"};
+	const char *const reloaded[2] = {"reloaded", "loaded"};
+
+	// Addresses of the data objects of the symbol table, a byte around
+	// each too.
+	void data_addresses(const char *binary, std::vector<uint64_t>& addresses) {
+		const int fd = open(binary, O_RDONLY);
+		if (-1 == fd)
+			return;
+		elf_version(EV_CURRENT);
+		Elf *const elf = elf_begin(fd, ELF_C_READ, NULL);
+		for (Elf_Scn *scn = 0; !!elf && 0 != (scn = elf_nextscn(elf, scn));) {
+			GElf_Shdr shdr;
+			Elf_Data *const data = elf_getdata(scn, 0);
+			if (!gelf_getshdr(scn, &shdr) || SHT_SYMTAB != shdr.sh_type || !data)
+				continue;
+			GElf_Sym sym;
+			for (int i = 0; gelf_getsym(data, i, &sym); ++i) {
+				if (STT_OBJECT != GELF_ST_TYPE(sym.st_info) || 0 == sym.st_value)
+					continue;
+				for (uint64_t a = sym.st_value - 1; a <= sym.st_value + sym.st_size; ++a)
+					addresses.push_back(a);
+			}
+		}
+		if (!!elf)
+			elf_end(elf);
+		close(fd);
+	}
+
+	std::string describe(const VarInfo& vi, const uint64_t address) {
+		VarInfo::Symbol s;
+		if (!vi.symbolize(address, s))
+			return "<none>";
+		return vi.text(s.name) + ':' + std::to_string(s.line) + '+' +
+			std::to_string(s.offset) + ' ' + vi.result_type(s.result) + ' ' +
+			vi.result_fieldname(s.result);
+	}
+
+	// Answers of type() and fieldname() for every line of the sources and
+	// every name of sample.h, then of symbolize() for the addresses.
+	struct answers_t {
+		answers_t() : known(0), found(0) {};
+
+		std::vector<std::string> what;
+		std::vector<std::string> answers;
+		size_t known;	// types found
+		size_t found;	// addresses symbolized
+	};
+
+	void ask(const VarInfo& vi, const std::vector<const char*>& sources,
+		const std::vector<uint64_t>& addresses, answers_t& a) {
+		for (auto source = sources.begin(); sources.end() != source; ++source) {
+			const size_t lines = count_lines(*source);
+			for (size_t line = 1; line <= lines; ++line) {
+				for (size_t n = 0; n < sizeof(sample_names) / sizeof(*sample_names); ++n) {
+					const std::string what = std::string(sample_names[n]) +
+						" at " + *source + ':' + std::to_string(line);
+					a.what.push_back(what);
+					a.answers.push_back(vi.type(*source, line, sample_names[n]));
+					a.known += "<Unknown>" != a.answers.back();
+					for (unsigned offset = 0; offset < MAX_OFFSET; ++offset) {
+						a.what.push_back(what + '+' + std::to_string(offset));
+						a.answers.push_back(vi.fieldname(*source, line,
+							sample_names[n], offset));
+					}
+				}
+			}
+		}
+		for (auto address = addresses.begin(); addresses.end() != address; ++address) {
+			a.what.push_back("symbolize " + std::to_string(*address));
+			a.answers.push_back(describe(vi, *address));
+			a.found += "<none>" != a.answers.back();
+		}
+	}
+
+	// Returns the number of differences.
+	size_t compare(const char *binary, const answers_t& one,
+		const answers_t& other, const char *const sides[2]) {
+		size_t differences = 0;
+		for (size_t i = 0; i < one.answers.size(); ++i) {
+			same(binary, one.what[i].c_str(), one.answers[i], other.answers[i],
+				differences, sides);
+		}
+		if (0 == one.known) {
+			fprintf(stderr, "%s: no variables are found\n", binary);
+			++differences;
+		}
+		if (0 == one.found) {
+			fprintf(stderr, "%s: no variables are symbolized\n", binary);
+			++differences;
+		}
+		return differences;
+	}
+
+	// A reload of the binary as it is keeps all the units, whichever
+	// reader parsed them.
+	size_t check_reload(const char *binary, const bool native) {
+		VarInfo::Options options;
+		options.native = native;
+		options.incremental = true;
+		VarInfo vi;
+		if (!vi.init(binary, options)) {
+			fprintf(stderr, "%s: failed to read\n", binary);
+			return 1;
+		}
+		const size_t units = vi.stats().units;
+		if (!vi.reload()) {
+			fprintf(stderr, "%s: failed to reload\n", binary);
+			return 1;
+		}
+		const VarInfo::Stats stats = vi.stats();
+		if (units == stats.units_reused && 0 == stats.units)
+			return 0;
+		fprintf(stderr, "%s: reload (%s) kept %zu of %zu units, parsed %zu\n",
+			binary, native ? "native" : "libdwarf", stats.units_reused, units,
+			stats.units);
+		return 1;
+	}
+
+	// Returns the number of differences.
+	size_t crosscheck(const char *source, const char *binary) {
+		VarInfo::Options options;
+		VarInfo libdwarf;
+		options.native = false;
+		const bool libdwarf_read = libdwarf.init(binary, options);
+		VarInfo native;
+		options.native = true;
+		const bool native_read = native.init(binary, options);
+		if (!libdwarf_read || !native_read) {
+			fprintf(stderr, "%s: failed to read (native %d, libdwarf %d)\n",
+				binary, native_read, libdwarf_read);
+			return 1;
+		}
+
+		const std::vector<const char*> sources(1, source);
+		std::vector<uint64_t> addresses;
+		data_addresses(binary, addresses);
+		answers_t n_answers, l_answers;
+		ask(native, sources, addresses, n_answers);
+		ask(libdwarf, sources, addresses, l_answers);
+		size_t differences = compare(binary, n_answers, l_answers, readers);
+
+		const VarInfo::Stats n = native.stats(), l = libdwarf.stats();
+		same(binary, "variables", n.variables, l.variables, differences, readers);
+		same(binary, "types", n.types, l.types, differences, readers);
+		same(binary, "units", n.units, l.units, differences, readers);
+		differences += check_reload(binary, true) + check_reload(binary, false);
+		printf("%s: %zu answers, %zu addresses, %zu variables, %zu types, %zu units: %zu differences\n",
+			binary, n_answers.answers.size() - addresses.size(),
+			addresses.size(), n.variables, n.types, n.units, differences);
+		return differences;
+	}
+
+	// Replaces 'to' at once, as the linker does.
+	bool replace(const char *from, const std::string& to) {
+		const std::string next = to + ".next";
+		{
+			std::ifstream in(from, std::ios::binary);
+			std::ofstream out(next.c_str(), std::ios::binary | std::ios::trunc);
+			if (!in || !(out << in.rdbuf()))
+				return false;
+		}
+		return 0 == rename(next.c_str(), to.c_str());
+	}
+
+	// Loads 'before', queries it and reloads it rebuilt as 'after', the
+	// answers and the counts must be those of 'after' loaded anew. The
+	// units kept are counted as parsed.
+	size_t check_rebuild(const char *before, const char *after,
+		const std::vector<const char*>& sources, const VarInfo::Options& options,
+		const char *mode) {
+		const std::string binary = std::string(after) + ".reloaded";
+		const std::string name = binary + " (" + mode + ')';
+		VarInfo vi;
+		if (!replace(before, binary) || !vi.init(binary, options)) {
+			fprintf(stderr, "%s: failed to read %s\n", name.c_str(), before);
+			return 1;
+		}
+		std::vector<uint64_t> addresses;
+		data_addresses(before, addresses);
+		// The lazy mode loads the units by the queries.
+		answers_t loaded;
+		ask(vi, sources, addresses, loaded);
+		if (!replace(after, binary) || !vi.reload()) {
+			fprintf(stderr, "%s: failed to reload %s\n", name.c_str(), after);
+			return 1;
+		}
+		VarInfo fresh;
+		if (!fresh.init(after, options)) {
+			fprintf(stderr, "%s: failed to read %s\n", name.c_str(), after);
+			return 1;
+		}
+
+		addresses.clear();
+		data_addresses(after, addresses);
+		answers_t r_answers, f_answers;
+		ask(vi, sources, addresses, r_answers);
+		ask(fresh, sources, addresses, f_answers);
+		size_t differences = compare(name.c_str(), r_answers, f_answers,
+			reloaded);
+
+		const VarInfo::Stats r = vi.stats(), f = fresh.stats();
+		const char *const what = name.c_str();
+		same(what, "variables", r.variables, f.variables, differences, reloaded);
+		same(what, "types", r.types, f.types, differences, reloaded);
+		same(what, "units", r.units + r.units_reused, f.units, differences,
+			reloaded);
+		if (options.incremental && 0 == r.units_reused) {
+			fprintf(stderr, "%s: no units are kept\n", what);
+			++differences;
+		}
+		printf("%s: %zu answers, %zu units kept, %zu parsed: %zu differences\n",
+			what, r_answers.answers.size(), r.units_reused, r.units, differences);
+		unlink(binary.c_str());
+		return differences;
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	if (argc > 4 && std::string("-r") == argv[1]) {
+		const std::vector<const char*> sources(argv + 4, argv + argc);
+		size_t differences = 0;
+		for (int native = 0; native < 2; ++native) {
+			VarInfo::Options options;
+			options.native = !!native;
+			const std::string reader = readers[!native];
+			differences += check_rebuild(argv[2], argv[3], sources, options,
+				(reader + ", eager").c_str());
+			options.incremental = true;
+			differences += check_rebuild(argv[2], argv[3], sources, options,
+				(reader + ", incremental").c_str());
+			options.lazy = true;
+			differences += check_rebuild(argv[2], argv[3], sources, options,
+				(reader + ", lazy").c_str());
+		}
+		return 0 == differences ? 0 : 1;
+	}
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <source> <binary>...\n"
+			"       %s -r <before> <after> <source>...\n", argv[0], argv[0]);
+		return 1;
+	}
+	size_t differences = 0;
+	for (int i = 2; i < argc; ++i)
+		differences += crosscheck(argv[1], argv[i]);
+	return 0 == differences ? 0 : 1;
+}
@@ -0,0 +1,1057 @@
+/// Reader of the part of DWARF the variables data base needs.
+///
+#include <string.h>
+#include <algorithm>
+#include "dwarfreader.h"
+
+namespace {
+	// DWARF constants the reader needs. They are spelled out here, not
+	// taken from libdwarf dwarf.h, as older ones don't know DWARF 5.
+	enum {
+		FORM_ADDR = 0x01,
+		FORM_BLOCK2 = 0x03,
+		FORM_BLOCK4 = 0x04,
+		FORM_DATA2 = 0x05,
+		FORM_DATA4 = 0x06,
+		FORM_DATA8 = 0x07,
+		FORM_STRING = 0x08,
+		FORM_BLOCK = 0x09,
+		FORM_BLOCK1 = 0x0a,
+		FORM_DATA1 = 0x0b,
+		FORM_FLAG = 0x0c,
+		FORM_SDATA = 0x0d,
+		FORM_STRP = 0x0e,
+		FORM_UDATA = 0x0f,
+		FORM_REF_ADDR = 0x10,
+		FORM_REF1 = 0x11,
+		FORM_REF2 = 0x12,
+		FORM_REF4 = 0x13,
+		FORM_REF8 = 0x14,
+		FORM_REF_UDATA = 0x15,
+		FORM_INDIRECT = 0x16,
+		FORM_SEC_OFFSET = 0x17,
+		FORM_EXPRLOC = 0x18,
+		FORM_FLAG_PRESENT = 0x19,
+		FORM_STRX = 0x1a,
+		FORM_ADDRX = 0x1b,
+		FORM_REF_SUP4 = 0x1c,
+		FORM_STRP_SUP = 0x1d,
+		FORM_DATA16 = 0x1e,
+		FORM_LINE_STRP = 0x1f,
+		FORM_REF_SIG8 = 0x20,
+		FORM_IMPLICIT_CONST = 0x21,
+		FORM_LOCLISTX = 0x22,
+		FORM_RNGLISTX = 0x23,
+		FORM_REF_SUP8 = 0x24,
+		FORM_STRX1 = 0x25,
+		FORM_STRX2 = 0x26,
+		FORM_STRX3 = 0x27,
+		FORM_STRX4 = 0x28,
+		FORM_ADDRX1 = 0x29,
+		FORM_ADDRX2 = 0x2a,
+		FORM_ADDRX3 = 0x2b,
+		FORM_ADDRX4 = 0x2c,
+		FORM_GNU_ADDR_INDEX = 0x1f01,
+		FORM_GNU_STR_INDEX = 0x1f02,
+		FORM_GNU_REF_ALT = 0x1f20,
+		FORM_GNU_STRP_ALT = 0x1f21,
+	};
+
+	enum {
+		AT_SIBLING = 0x01,
+		AT_LOCATION = 0x02,
+		AT_STMT_LIST = 0x10,
+		AT_COMP_DIR = 0x1b,
+		AT_STR_OFFSETS_BASE = 0x72,
+		AT_ADDR_BASE = 0x73,
+		AT_GNU_ADDR_BASE = 0x2133,
+	};
+
+	enum {
+		OP_ADDR = 0x03,
+		OP_ADDRX = 0xa1,
+		OP_GNU_ADDR_INDEX = 0xfb,
+	};
+
+	enum {
+		UT_COMPILE = 1,
+		UT_TYPE = 2,
+		UT_PARTIAL = 3,
+		UT_SKELETON = 4,
+		UT_SPLIT_COMPILE = 5,
+		UT_SPLIT_TYPE = 6,
+	};
+
+	enum {
+		LNCT_PATH = 1,
+		LNCT_DIRECTORY_INDEX = 2,
+	};
+
+	// Little endian integers, LEB128 and strings, all of them fail
+	// rather than read past 'end'.
+	inline bool read_fixed(const unsigned char *&p, const unsigned char *end,
+		unsigned size, uint64_t& value) {
+		if (size_t(end - p) < size)
+			return false;
+		value = 0;
+		for (unsigned i = size; i > 0; --i)
+			value = value << 8 | p[i - 1];
+		p += size;
+		return true;
+	}
+
+	inline bool read_uleb(const unsigned char *&p, const unsigned char *end,
+		uint64_t& value) {
+		value = 0;
+		for (unsigned shift = 0; p < end; shift += 7) {
+			const unsigned char b = *p++;
+			if (shift < 64)
+				value |= uint64_t(b & 0x7f) << shift;
+			if (!(b & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	inline bool read_sleb(const unsigned char *&p, const unsigned char *end,
+		int64_t& value) {
+		uint64_t v = 0;
+		for (unsigned shift = 0; p < end; shift += 7) {
+			const unsigned char b = *p++;
+			if (shift < 64)
+				v |= uint64_t(b & 0x7f) << shift;
+			if (!(b & 0x80)) {
+				if (shift + 7 < 64 && (b & 0x40))
+					v |= ~uint64_t(0) << (shift + 7);
+				value = v;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	inline bool read_cstr(const unsigned char *&p, const unsigned char *end,
+		const char *&s) {
+		const void *const nul = memchr(p, 0, end - p);
+		if (!nul)
+			return false;
+		s = (const char *)p;
+		p = (const unsigned char *)nul + 1;
+		return true;
+	}
+
+	inline bool read_block(const unsigned char *&p, const unsigned char *end,
+		uint64_t size, const unsigned char *&data) {
+		if (uint64_t(end - p) < size)
+			return false;
+		data = p;
+		p += size;
+		return true;
+	}
+
+	// The string at 'offset' in the section, it must end in it.
+	bool section_string(const dwarfreader::section_t& s, uint64_t offset,
+		const char *&value) {
+		if (offset >= s.size)
+			return false;
+		const unsigned char *p = s.data + offset;
+		return read_cstr(p, s.data + s.size, value);
+	}
+
+	// Hashing of unit::fingerprint().
+	inline uint64_t mix(uint64_t h, const uint64_t value) {
+		h ^= value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+		return h * 0xff51afd7ed558ccdull;
+	}
+
+	inline uint64_t mix(uint64_t h, const unsigned char *data, uint64_t size) {
+		h = mix(h, size);
+		for (; size >= 8; data += 8, size -= 8) {
+			uint64_t v;
+			memcpy(&v, data, 8);
+			h = mix(h, v);
+		}
+		for (; size > 0; ++data, --size)
+			h = mix(h, *data);
+		return h;
+	}
+
+	bool known_form(uint64_t form) {
+		return (form >= FORM_ADDR && form <= FORM_ADDRX4 && 0x02 != form) ||
+			FORM_GNU_ADDR_INDEX == form || FORM_GNU_STR_INDEX == form ||
+			FORM_GNU_REF_ALT == form || FORM_GNU_STRP_ALT == form;
+	}
+
+	// Reads a value of the form at 'p', 'form' becomes the actual form of
+	// DW_FORM_indirect. Constants, offsets, indices and sizes of blocks
+	// and strings go to 'value', blocks and inline strings to 'data'.
+	bool read_form(const dwarfreader::header_t& h, uint16_t& form,
+		int64_t implicit, const unsigned char *&p, const unsigned char *end,
+		uint64_t& value, const unsigned char *&data) {
+		data = 0;
+		switch (form) {
+		case FORM_ADDR:
+			return read_fixed(p, end, h.address_size, value);
+		case FORM_DATA1:
+		case FORM_FLAG:
+		case FORM_REF1:
+		case FORM_STRX1:
+		case FORM_ADDRX1:
+			return read_fixed(p, end, 1, value);
+		case FORM_DATA2:
+		case FORM_REF2:
+		case FORM_STRX2:
+		case FORM_ADDRX2:
+			return read_fixed(p, end, 2, value);
+		case FORM_STRX3:
+		case FORM_ADDRX3:
+			return read_fixed(p, end, 3, value);
+		case FORM_DATA4:
+		case FORM_REF4:
+		case FORM_REF_SUP4:
+		case FORM_STRX4:
+		case FORM_ADDRX4:
+			return read_fixed(p, end, 4, value);
+		case FORM_DATA8:
+		case FORM_REF8:
+		case FORM_REF_SIG8:
+		case FORM_REF_SUP8:
+			return read_fixed(p, end, 8, value);
+		case FORM_STRP:
+		case FORM_LINE_STRP:
+		case FORM_SEC_OFFSET:
+		case FORM_STRP_SUP:
+		case FORM_GNU_REF_ALT:
+		case FORM_GNU_STRP_ALT:
+			return read_fixed(p, end, h.offset_size, value);
+		case FORM_REF_ADDR:
+			return read_fixed(p, end,
+				h.version <= 2 ? h.address_size : h.offset_size, value);
+		case FORM_UDATA:
+		case FORM_REF_UDATA:
+		case FORM_STRX:
+		case FORM_ADDRX:
+		case FORM_LOCLISTX:
+		case FORM_RNGLISTX:
+		case FORM_GNU_ADDR_INDEX:
+		case FORM_GNU_STR_INDEX:
+			return read_uleb(p, end, value);
+		case FORM_SDATA: {
+			int64_t v = 0;
+			if (!read_sleb(p, end, v))
+				return false;
+			value = v;
+			return true;
+		}
+		case FORM_STRING: {
+			const char *s = 0;
+			if (!read_cstr(p, end, s))
+				return false;
+			data = (const unsigned char *)s;
+			value = (const char *)p - s - 1;
+			return true;
+		}
+		case FORM_BLOCK1:
+			return read_fixed(p, end, 1, value) && read_block(p, end, value, data);
+		case FORM_BLOCK2:
+			return read_fixed(p, end, 2, value) && read_block(p, end, value, data);
+		case FORM_BLOCK4:
+			return read_fixed(p, end, 4, value) && read_block(p, end, value, data);
+		case FORM_BLOCK:
+		case FORM_EXPRLOC:
+			return read_uleb(p, end, value) && read_block(p, end, value, data);
+		case FORM_DATA16:
+			value = 16;
+			return read_block(p, end, value, data);
+		case FORM_FLAG_PRESENT:
+			value = 1;
+			return true;
+		case FORM_IMPLICIT_CONST:
+			value = implicit;
+			return true;
+		case FORM_INDIRECT: {
+			uint64_t actual = 0;
+			if (!read_uleb(p, end, actual) || FORM_INDIRECT == actual ||
+				FORM_IMPLICIT_CONST == actual || !known_form(actual))
+				return false;
+			form = actual;
+			return read_form(h, form, 0, p, end, value, data);
+		}
+		default:
+			return false;
+		}
+	}
+}
+
+
+const char *const dwarfreader::section_names[SECTIONS] = {
+	".debug_info",
+	".debug_abbrev",
+	".debug_line",
+	".debug_str",
+	".debug_line_str",
+	".debug_str_offsets",
+	".debug_addr",
+	".debug_types",
+};
+
+
+bool dwarfreader::init(const section_t sections[SECTIONS]) {
+	memcpy(_sections, sections, sizeof(_sections));
+	_offsets.clear();
+	_headers.clear();
+	_abbrevs.clear();
+	_specs.clear();
+	const section_t& info = _sections[INFO];
+	if (!info.data || 0 == info.size || !_sections[ABBREV].data)
+		return false;
+
+	// Units of a program mostly share a few abbreviation tables.
+	tables_t tables;
+	return read_units(INFO, tables) && read_units(TYPES, tables);
+}
+
+
+// Lists the units of .debug_info or .debug_types.
+bool dwarfreader::read_units(section_id id, tables_t& tables) {
+	const section_t& info = _sections[id];
+	if (!info.data)
+		return true;
+	const unsigned char *const end = info.data + info.size;
+	for (const unsigned char *p = info.data; p < end;) {
+		header_t h;
+		h.offset = p - info.data;
+		h.section = id;
+		h.signature = 0;
+		h.type_offset = 0;
+		uint64_t length = 0, abbrev_offset = 0, value = 0;
+		if (!read_fixed(p, end, 4, length))
+			return false;
+		h.offset_size = 4;
+		if (0xffffffff == length) {
+			h.offset_size = 8;
+			if (!read_fixed(p, end, 8, length))
+				return false;
+		} else if (length >= 0xfffffff0) {
+			return false;
+		}
+		if (length > uint64_t(end - p))
+			return false;
+		const unsigned char *const unit_end = p + length;
+		h.size = unit_end - (info.data + h.offset);
+		if (!read_fixed(p, unit_end, 2, value) || value < 2 || value > 5)
+			return false;
+		h.version = value;
+		if (TYPES == id && 4 != h.version)
+			return false;
+		if (h.version < 5) {
+			if (!read_fixed(p, unit_end, h.offset_size, abbrev_offset) ||
+				!read_fixed(p, unit_end, 1, value))
+				return false;
+			h.address_size = value;
+			if (TYPES == id && (!read_fixed(p, unit_end, 8, h.signature) ||
+				!read_fixed(p, unit_end, h.offset_size, h.type_offset)))
+				return false;
+		} else {
+			uint64_t type = 0;
+			if (!read_fixed(p, unit_end, 1, type) ||
+				!read_fixed(p, unit_end, 1, value) ||
+				!read_fixed(p, unit_end, h.offset_size, abbrev_offset))
+				return false;
+			h.address_size = value;
+			switch (type) {
+			case UT_COMPILE:
+			case UT_PARTIAL:
+				break;
+			case UT_SKELETON:
+			case UT_SPLIT_COMPILE:
+				p += 8;		// unit id
+				break;
+			case UT_TYPE:
+			case UT_SPLIT_TYPE:
+				if (!read_fixed(p, unit_end, 8, h.signature) ||
+					!read_fixed(p, unit_end, h.offset_size, h.type_offset))
+					return false;
+				break;
+			default:
+				return false;
+			}
+			if (p > unit_end)
+				return false;
+		}
+		if (0 != h.type_offset && h.type_offset >= h.size)
+			return false;
+		if (4 != h.address_size && 8 != h.address_size)
+			return false;
+		h.first = p - (info.data + h.offset);
+
+		auto t = tables.find(abbrev_offset);
+		if (tables.end() == t) {
+			std::pair<uint32_t, uint32_t> table;
+			if (!read_abbrevs(abbrev_offset, table.first, table.second))
+				return false;
+			t = tables.insert(std::make_pair(abbrev_offset, table)).first;
+		}
+		h.abbrevs = t->second.first;
+		h.codes = t->second.second;
+		_headers.push_back(h);
+		_offsets.push_back((TYPES == id ? TYPES_UNIT : 0) | (h.offset + h.first));
+		p = unit_end;
+	}
+	return true;
+}
+
+
+size_t dwarfreader::find(uint64_t offset) const {
+	auto u = std::lower_bound(_offsets.begin(), _offsets.end(), offset);
+	return _offsets.end() != u && *u == offset ? u - _offsets.begin() :
+		_offsets.size();
+}
+
+
+bool dwarfreader::static_location(const unsigned char *expr, const uint64_t size,
+	uint64_t& value, bool& indexed) {
+	if (0 == size)
+		return false;
+	const unsigned char *p = expr + 1;
+	const unsigned char *const end = expr + size;
+	indexed = OP_ADDRX == expr[0] || OP_GNU_ADDR_INDEX == expr[0];
+	if (indexed)
+		return read_uleb(p, end, value) && end == p;
+	return OP_ADDR == expr[0] && (5 == size || 9 == size) &&
+		read_fixed(p, end, size - 1, value);
+}
+
+
+// Decodes the abbreviation table at 'offset' into _abbrevs[first, first +
+// count), by code.
+bool dwarfreader::read_abbrevs(uint64_t offset, uint32_t& first,
+	uint32_t& count) {
+	const section_t& s = _sections[ABBREV];
+	if (offset >= s.size)
+		return false;
+	const unsigned char *p = s.data + offset;
+	const unsigned char *const end = s.data + s.size;
+	first = _abbrevs.size();
+	count = 0;
+	for (;;) {
+		uint64_t code = 0, tag = 0;
+		if (!read_uleb(p, end, code))
+			return false;
+		if (0 == code)
+			break;
+		// Codes are small and dense in practice.
+		if (code > (1u << 20) || !read_uleb(p, end, tag) || 0 == tag || p >= end)
+			return false;
+		if (code >= count) {
+			count = code + 1;
+			abbrev_t unused = {0, false, 0, 0};
+			_abbrevs.resize(first + count, unused);
+		}
+		abbrev_t& a = _abbrevs[first + code];
+		if (0 != a.tag)
+			return false;
+		a.tag = tag;
+		a.children = 0 != *p++;
+		a.specs = _specs.size();
+		for (;;) {
+			uint64_t name = 0, form = 0;
+			if (!read_uleb(p, end, name) || !read_uleb(p, end, form))
+				return false;
+			if (0 == name && 0 == form)
+				break;
+			if (name > 0xffff || !known_form(form))
+				return false;
+			spec_t spec = {uint16_t(name), uint16_t(form), 0};
+			if (FORM_IMPLICIT_CONST == form && !read_sleb(p, end, spec.implicit))
+				return false;
+			_specs.push_back(spec);
+		}
+		a.count = _specs.size() - a.specs;
+	}
+	return true;
+}
+
+
+bool dwarfreader::attribute::udata(uint64_t& value) const {
+	switch (_form) {
+	case FORM_DATA1:
+	case FORM_DATA2:
+	case FORM_DATA4:
+	case FORM_DATA8:
+	case FORM_UDATA:
+	case FORM_IMPLICIT_CONST:
+		value = _value;
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+bool dwarfreader::attribute::sdata(int64_t& value) const {
+	switch (_form) {
+	case FORM_DATA1:
+		value = int8_t(_value);
+		return true;
+	case FORM_DATA2:
+		value = int16_t(_value);
+		return true;
+	case FORM_DATA4:
+		value = int32_t(_value);
+		return true;
+	case FORM_DATA8:
+	case FORM_SDATA:
+	case FORM_IMPLICIT_CONST:
+		value = int64_t(_value);
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+bool dwarfreader::attribute::string(const char *&value) const {
+	const section_t *const sections = _unit->_reader->_sections;
+	switch (_form) {
+	case FORM_STRING:
+		value = (const char *)_data;
+		return true;
+	case FORM_STRP:
+		return section_string(sections[STR], _value, value);
+	case FORM_LINE_STRP:
+		return section_string(sections[LINE_STR], _value, value);
+	case FORM_STRX:
+	case FORM_STRX1:
+	case FORM_STRX2:
+	case FORM_STRX3:
+	case FORM_STRX4:
+	case FORM_GNU_STR_INDEX: {
+		const section_t& offsets = sections[STR_OFFSETS];
+		const unsigned size = _unit->_header->offset_size;
+		const uint64_t at = _unit->_str_offsets + _value * size;
+		uint64_t offset = 0;
+		if (at < _unit->_str_offsets || at >= offsets.size)
+			return false;
+		const unsigned char *p = offsets.data + at;
+		return read_fixed(p, offsets.data + offsets.size, size, offset) &&
+			section_string(sections[STR], offset, value);
+	}
+	default:
+		return false;
+	}
+}
+
+
+bool dwarfreader::attribute::block(const unsigned char *&data,
+	uint64_t& size) const {
+	switch (_form) {
+	case FORM_BLOCK1:
+	case FORM_BLOCK2:
+	case FORM_BLOCK4:
+	case FORM_BLOCK:
+	case FORM_EXPRLOC:
+		data = _data;
+		size = _value;
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+bool dwarfreader::attribute::ref(uint64_t& offset) const {
+	switch (_form) {
+	case FORM_REF1:
+	case FORM_REF2:
+	case FORM_REF4:
+	case FORM_REF8:
+	case FORM_REF_UDATA:
+		if (_value >= _unit->_header->size)
+			return false;
+		offset = _value;
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+bool dwarfreader::attribute::signature(uint64_t& value) const {
+	if (FORM_REF_SIG8 != _form)
+		return false;
+	value = _value;
+	return true;
+}
+
+
+bool dwarfreader::attribute::addr(uint64_t& value) const {
+	switch (_form) {
+	case FORM_ADDR:
+		value = _value;
+		return true;
+	case FORM_ADDRX:
+	case FORM_ADDRX1:
+	case FORM_ADDRX2:
+	case FORM_ADDRX3:
+	case FORM_ADDRX4:
+	case FORM_GNU_ADDR_INDEX:
+		return address(_value, value);
+	default:
+		return false;
+	}
+}
+
+
+bool dwarfreader::attribute::address(const uint64_t index, uint64_t& value) const {
+	const section_t& addrs = _unit->_reader->_sections[ADDR];
+	const unsigned size = _unit->_header->address_size;
+	const uint64_t at = _unit->_addr_base + index * size;
+	if (index > addrs.size || at < _unit->_addr_base || at >= addrs.size)
+		return false;
+	const unsigned char *p = addrs.data + at;
+	return read_fixed(p, addrs.data + addrs.size, size, value);
+}
+
+
+dwarfreader::unit::unit(const dwarfreader& reader, size_t i) :
+	_reader(&reader), _header(&reader._headers[i]),
+	_begin(reader._sections[_header->section].data + _header->offset),
+	_end(_begin + _header->size), _str_offsets(0), _addr_base(0),
+	_stmt_list(~uint64_t(0)), _comp_dir("") {
+	// Bases of the string offsets and of the addresses must be known
+	// before strings and addresses of the unit are read. A unit without
+	// DW_AT_str_offsets_base uses the first table, after its header.
+	if (_header->version >= 5)
+		_str_offsets = 8 == _header->offset_size ? 16 : 8;
+	uint64_t at = first();
+	die d;
+	if (!next(at, d) || 0 == d.tag)
+		return;
+	attribute a, comp_dir;
+	bool has_comp_dir = false;
+	for (attributes attrs(*this, d); attrs.next(a);) {
+		switch (a.name()) {
+		case AT_STR_OFFSETS_BASE:
+			_str_offsets = a._value;
+			break;
+		case AT_ADDR_BASE:
+		case AT_GNU_ADDR_BASE:
+			_addr_base = a._value;
+			break;
+		case AT_STMT_LIST:
+			if (FORM_SEC_OFFSET == a.form() || FORM_DATA4 == a.form() ||
+				FORM_DATA8 == a.form())
+				_stmt_list = a._value;
+			break;
+		case AT_COMP_DIR:
+			comp_dir = a;
+			has_comp_dir = true;
+			break;
+		default:;
+		}
+	}
+	if (has_comp_dir && !comp_dir.string(_comp_dir))
+		_comp_dir = "";
+}
+
+
+bool dwarfreader::unit::next(uint64_t& at, die& d) const {
+	if (at >= _header->size)
+		return false;
+	const unsigned char *p = _begin + at;
+	uint64_t code = 0;
+	if (!read_uleb(p, _end, code))
+		return false;
+	d.offset = at;
+	d.sibling = 0;
+	d.attrs = p;
+	if (0 == code) {
+		d.tag = 0;
+		d.children = false;
+		d.abbrev = 0;
+		at = p - _begin;
+		return true;
+	}
+	if (code >= _header->codes)
+		return false;
+	const abbrev_t& a = _reader->_abbrevs[_header->abbrevs + code];
+	if (0 == a.tag)
+		return false;
+	d.tag = a.tag;
+	d.children = a.children;
+	d.abbrev = &a;
+	const spec_t *const specs = &_reader->_specs[a.specs];
+	for (uint32_t i = 0; i < a.count; ++i) {
+		uint16_t form = specs[i].form;
+		uint64_t value = 0;
+		const unsigned char *data = 0;
+		if (!read_form(*_header, form, specs[i].implicit, p, _end, value, data))
+			return false;
+		if (AT_SIBLING == specs[i].name && form >= FORM_REF1 &&
+			form <= FORM_REF_UDATA)
+			d.sibling = value;
+	}
+	at = p - _begin;
+	return true;
+}
+
+
+bool dwarfreader::unit::skip_children(const die& d, uint64_t& at) const {
+	if (d.sibling > at && d.sibling < _header->size) {
+		at = d.sibling;
+		return true;
+	}
+	for (size_t depth = 1; depth > 0;) {
+		die c;
+		if (!next(at, c))
+			return false;
+		if (0 == c.tag)
+			--depth;
+		else if (c.children) {
+			if (c.sibling > at && c.sibling < _header->size)
+				at = c.sibling;
+			else
+				++depth;
+		}
+	}
+	return true;
+}
+
+
+bool dwarfreader::unit::attributes::next(attribute& a) {
+	if (!_die->abbrev || _i >= _die->abbrev->count)
+		return false;
+	const spec_t& spec = _unit->_reader->_specs[_die->abbrev->specs + _i];
+	a._unit = _unit;
+	a._name = spec.name;
+	a._form = spec.form;
+	if (!read_form(*_unit->_header, a._form, spec.implicit, _at, _unit->_end,
+		a._value, a._data))
+		return false;
+	++_i;
+	return true;
+}
+
+
+// Header of the line table of the unit.
+struct dwarfreader::unit::line_header_t {
+	header_t format;				// of the line table, for read_form()
+	const unsigned char *tables;	// directories and files
+	const unsigned char *program;
+	const unsigned char *end;
+	unsigned min_inst;
+	int line_base;
+	unsigned line_range;
+	unsigned opcode_base;
+	const unsigned char *opcode_lengths;
+};
+
+
+bool dwarfreader::unit::read_line_header(line_header_t& h) const {
+	const section_t& s = _reader->_sections[LINE];
+	if (_stmt_list >= s.size)
+		return false;
+	const unsigned char *p = s.data + _stmt_list;
+	const unsigned char *const section_end = s.data + s.size;
+	uint64_t length = 0, value = 0, header_length = 0;
+	if (!read_fixed(p, section_end, 4, length))
+		return false;
+	h.format.offset_size = 4;
+	if (0xffffffff == length) {
+		h.format.offset_size = 8;
+		if (!read_fixed(p, section_end, 8, length))
+			return false;
+	}
+	if (length > uint64_t(section_end - p))
+		return false;
+	h.end = p + length;
+	if (!read_fixed(p, h.end, 2, value) || value < 2 || value > 5)
+		return false;
+	h.format.version = value;
+	h.format.address_size = _header->address_size;
+	if (h.format.version >= 5) {
+		uint64_t segment_selector_size = 0;
+		if (!read_fixed(p, h.end, 1, value) ||
+			!read_fixed(p, h.end, 1, segment_selector_size))
+			return false;
+		h.format.address_size = value;
+	}
+	if (!read_fixed(p, h.end, h.format.offset_size, header_length) ||
+		header_length > uint64_t(h.end - p))
+		return false;
+	h.program = p + header_length;
+	if (!read_fixed(p, h.program, 1, value))
+		return false;
+	h.min_inst = value;
+	if (h.format.version >= 4 && !read_fixed(p, h.program, 1, value))
+		return false;	// maximum operations per instruction
+	if (!read_fixed(p, h.program, 1, value))
+		return false;	// default is_stmt
+	if (!read_fixed(p, h.program, 1, value))
+		return false;
+	h.line_base = int8_t(value);
+	if (!read_fixed(p, h.program, 1, value) || 0 == value)
+		return false;
+	h.line_range = value;
+	if (!read_fixed(p, h.program, 1, value) || 0 == value ||
+		value - 1 > uint64_t(h.program - p))
+		return false;
+	h.opcode_base = value;
+	h.opcode_lengths = p;
+	h.tables = p + h.opcode_base - 1;
+	return true;
+}
+
+
+bool dwarfreader::unit::files(std::vector<std::string>& files,
+	unsigned& first) const {
+	line_header_t h;
+	if (!read_line_header(h))
+		return false;
+	const std::string comp_dir = _comp_dir;
+	std::vector<const char *> dirs;
+	const unsigned char *p = h.tables;
+	const unsigned char *const end = h.program;
+
+	// Relative paths are relative to the compilation directory, which is
+	// the directory 0 before DWARF 5.
+	auto add = [&](const char *name, uint64_t dir) {
+		std::string f = name;
+		if ('/' != f[0]) {
+			std::string d = dir < dirs.size() ? dirs[dir] : "";
+			if (!d.empty() && '/' != d[0] && (h.format.version >= 5 || 0 != dir) &&
+				d != comp_dir)
+				d = comp_dir + '/' + d;
+			if (!d.empty())
+				f = d + '/' + f;
+		}
+		files.push_back(f);
+	};
+
+	if (h.format.version < 5) {
+		first = 1;
+		dirs.push_back(comp_dir.c_str());
+		const char *s = 0;
+		while (p < end && 0 != *p) {
+			if (!read_cstr(p, end, s))
+				return false;
+			dirs.push_back(s);
+		}
+		++p;
+		while (p < end && 0 != *p) {
+			uint64_t dir = 0, ignored = 0;
+			if (!read_cstr(p, end, s) || !read_uleb(p, end, dir) ||
+				!read_uleb(p, end, ignored) || !read_uleb(p, end, ignored))
+				return false;
+			add(s, dir);
+		}
+		return true;
+	}
+
+	// DWARF 5 describes the fields of the entries first.
+	first = 0;
+	for (int table = 0; table < 2; ++table) {
+		uint64_t nformats = 0, count = 0;
+		if (!read_fixed(p, end, 1, nformats))
+			return false;
+		const unsigned char *const formats = p;
+		for (uint64_t i = 0; i < 2 * nformats; ++i) {
+			if (!read_uleb(p, end, count))
+				return false;
+		}
+		if (!read_uleb(p, end, count))
+			return false;
+		for (uint64_t e = 0; e < count; ++e) {
+			const char *name = 0;
+			uint64_t dir = 0;
+			const unsigned char *f = formats;
+			for (uint64_t i = 0; i < nformats; ++i) {
+				uint64_t type = 0, form = 0;
+				read_uleb(f, end, type);
+				read_uleb(f, end, form);
+				attribute a;
+				a._unit = this;
+				a._name = 0;
+				a._form = form;
+				if (FORM_IMPLICIT_CONST == form ||
+					!read_form(h.format, a._form, 0, p, end, a._value, a._data))
+					return false;
+				if (LNCT_PATH == type && !a.string(name))
+					return false;
+				if (LNCT_DIRECTORY_INDEX == type && !a.udata(dir))
+					return false;
+			}
+			if (!name)
+				return false;
+			if (0 == table)
+				dirs.push_back(name);
+			else
+				add(name, dir);
+		}
+	}
+	return true;
+}
+
+
+dwarfreader::unit::lines::lines(const unit& u) {
+	line_header_t h;
+	if (!u.read_line_header(h)) {
+		_at = _end = 0;
+		return;
+	}
+	_at = h.program;
+	_end = h.end;
+	_min_inst = h.min_inst;
+	_line_base = h.line_base;
+	_line_range = h.line_range;
+	_opcode_base = h.opcode_base;
+	_opcode_lengths = h.opcode_lengths;
+	reset();
+}
+
+
+void dwarfreader::unit::lines::reset() {
+	_address = 0;
+	_line = 1;
+}
+
+
+// Runs the line program up to the next row. Only the address and the line
+// registers are kept, the rows are those dwarf_srclines() gives.
+bool dwarfreader::unit::lines::next(uint64_t& address, uint64_t& line) {
+	uint64_t u = 0;
+	int64_t s = 0;
+	while (_at < _end) {
+		const unsigned op = *_at++;
+		if (op >= _opcode_base) {
+			const unsigned adjusted = op - _opcode_base;
+			_address += (adjusted / _line_range) * _min_inst;
+			_line += _line_base + int(adjusted % _line_range);
+			address = _address;
+			line = _line;
+			return true;
+		}
+		switch (op) {
+		case 0: {	// extended opcodes
+			if (!read_uleb(_at, _end, u) || 0 == u || u > uint64_t(_end - _at))
+				break;
+			const unsigned char *const next = _at + u;
+			const unsigned sub = *_at++;
+			if (1 == sub) {		// DW_LNE_end_sequence
+				address = _address;
+				line = _line;
+				reset();
+				_at = next;
+				return true;
+			}
+			if (2 == sub && u - 1 <= 8)		// DW_LNE_set_address
+				read_fixed(_at, next, u - 1, _address);
+			_at = next;
+			continue;
+		}
+		case 1:		// DW_LNS_copy
+			address = _address;
+			line = _line;
+			return true;
+		case 2:		// DW_LNS_advance_pc
+			if (!read_uleb(_at, _end, u))
+				break;
+			_address += u * _min_inst;
+			continue;
+		case 3:		// DW_LNS_advance_line
+			if (!read_sleb(_at, _end, s))
+				break;
+			_line += s;
+			continue;
+		case 9:		// DW_LNS_fixed_advance_pc
+			if (!read_fixed(_at, _end, 2, u))
+				break;
+			_address += u;
+			continue;
+		case 8:		// DW_LNS_const_add_pc
+			_address += ((255 - _opcode_base) / _line_range) * _min_inst;
+			continue;
+		default: {
+			// Operands of the others are skipped, ULEB128 each.
+			unsigned i = 0;
+			for (; i < _opcode_lengths[op - 1] && read_uleb(_at, _end, u); ++i);
+			if (i < _opcode_lengths[op - 1])
+				break;
+			continue;
+		}
+		}
+		// Broken program.
+		_at = _end;
+	}
+	return false;
+}
+
+
+uint64_t dwarfreader::unit::fingerprint(std::vector<uint64_t> *statics) const {
+	// Address 0 is of the code the linker dropped.
+	uint64_t base = ~uint64_t(0), address = 0, line = 0;
+	for (lines rows(*this); rows.next(address, line);) {
+		if (0 != address)
+			base = std::min(base, address);
+	}
+	if (~uint64_t(0) == base)
+		base = 0;
+
+	uint64_t h = mix(0, _header->version);
+	h = mix(h, _header->address_size);
+	h = mix(h, _header->signature);
+	h = mix(h, _header->type_offset);
+	std::vector<std::string> paths;
+	unsigned first_file = 0;
+	if (files(paths, first_file)) {
+		h = mix(h, first_file);
+		for (auto p = paths.begin(); paths.end() != p; ++p)
+			h = mix(h, (const unsigned char *)p->data(), p->size());
+	}
+	for (lines rows(*this); rows.next(address, line);) {
+		h = mix(h, address - base);
+		h = mix(h, line);
+	}
+
+	uint64_t at = first();
+	die d;
+	while (next(at, d)) {
+		h = mix(h, d.tag);
+		h = mix(h, d.children);
+		attribute a;
+		for (attributes attrs(*this, d); attrs.next(a);) {
+			h = mix(h, a._name);
+			h = mix(h, a._form);
+			const char *s = 0;
+			const unsigned char *data = 0;
+			uint64_t value = 0, address = 0;
+			bool indexed = false;
+			if (a.string(s))
+				h = mix(h, (const unsigned char *)s, strlen(s));
+			else if (a.addr(value))
+				h = mix(h, 0 == value ? value : value - base);
+			else if (AT_LOCATION == a._name && a.block(data, value) &&
+				static_location(data, value, address, indexed)) {
+				// Only the operation and the index in the address table
+				// are hashed, the data the linker moved keeps the unit.
+				if (indexed) {
+					h = mix(h, data, value);
+					if (!a.address(address, address))
+						address = 0;
+				} else
+					h = mix(h, data[0]);
+				if (!!statics)
+					statics->push_back(address);
+			} else if (a.block(data, value))
+				h = mix(h, data, value);
+			else if (FORM_DATA16 == a._form)
+				h = mix(h, a._data, 16);
+			// Offsets in the other sections change with other units.
+			else if (FORM_SEC_OFFSET != a._form && AT_STMT_LIST != a._name)
+				h = mix(h, a._value);
+		}
+	}
+	h = mix(h, at);
+	return 0 != h ? h : 1;
+}
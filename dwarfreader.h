@@ -0,0 +1,249 @@
+/// Reader of the part of DWARF 2-5 the variables data base needs: units,
+/// their DIEs and attributes and their line tables. Sections are decoded
+/// in place: strings point into them and walking DIEs allocates nothing,
+/// only the abbreviations are decoded once, by init(). Once initialized
+/// the reader is read only and can be shared by threads.
+///
+/// Only little endian DWARF is read, as the binaries the library runs on.
+///
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+class dwarfreader {
+public:
+	enum section_id {
+		INFO,
+		ABBREV,
+		LINE,
+		STR,
+		LINE_STR,
+		STR_OFFSETS,
+		ADDR,
+		TYPES,
+		SECTIONS
+	};
+
+	struct section_t {
+		const unsigned char *data;
+		size_t size;
+	};
+
+	/// ELF names of the sections by section_id.
+	static const char *const section_names[SECTIONS];
+
+	/// Takes the sections (missing ones are empty), which must stay while
+	/// the reader lives, lists the units and decodes their abbreviations.
+	/// Returns false if .debug_info uses anything the reader doesn't know
+	/// (versions, unit types, forms), such files are left to libdwarf.
+	bool init(const section_t sections[SECTIONS]);
+
+	/// Offsets of the unit DIEs in .debug_info (as dwarf_dieoffset() gives
+	/// them), in the order the units follow. Type units of .debug_types
+	/// (DWARF 4) follow, their offsets in it are marked with TYPES_UNIT.
+	const std::vector<uint64_t>& units() const { return _offsets; }
+	static const uint64_t TYPES_UNIT = 1ull << 63;
+	/// Number of the unit by the offset of its DIE, units().size() if
+	/// there is no such unit.
+	size_t find(uint64_t offset) const;
+
+	/// Location expression of static storage: a single DW_OP_addr, then
+	/// 'value' is the address, or a single DW_OP_addrx (or
+	/// DW_OP_GNU_addr_index), then 'indexed' is set and 'value' is the
+	/// index in the address table of the unit (@sa attribute::address).
+	static bool static_location(const unsigned char *expr, uint64_t size,
+		uint64_t& value, bool& indexed);
+
+	struct abbrev_t;
+	struct spec_t;
+	struct header_t;
+	class unit;
+
+	/// Attribute of a DIE. The accessors return false if the form is of
+	/// another class, the same way libdwarf dwarf_form*() calls fail.
+	class attribute {
+	public:
+		uint16_t name() const { return _name; }
+		uint16_t form() const { return _form; }
+
+		bool udata(uint64_t& value) const;
+		bool sdata(int64_t& value) const;
+		bool string(const char *&value) const;
+		/// Blocks and location expressions.
+		bool block(const unsigned char *&data, uint64_t& size) const;
+		/// References within the unit, as offsets from its start.
+		bool ref(uint64_t& offset) const;
+		/// References to type units (DW_FORM_ref_sig8).
+		bool signature(uint64_t& value) const;
+		bool addr(uint64_t& value) const;
+		/// Entry 'index' of the address table of the unit, as
+		/// DW_OP_addrx refers to it.
+		bool address(uint64_t index, uint64_t& value) const;
+
+	private:
+		friend class unit;
+		const unit *_unit;
+		uint16_t _name;
+		uint16_t _form;
+		uint64_t _value;				// or the size of the block
+		const unsigned char *_data;		// block, inline string
+	};
+
+	/// DIE of a unit, only refers to the sections.
+	struct die {
+		uint64_t offset;	// from the start of the unit
+		uint32_t tag;		// 0 - the null entry ending a list of siblings
+		bool children;
+		uint64_t sibling;	// DW_AT_sibling if the DIE has one, 0 otherwise
+		const unsigned char *attrs;
+		const abbrev_t *abbrev;
+	};
+
+	/// Walks DIEs and reads the line table of a unit, cheap to make.
+	class unit {
+	public:
+		unit(const dwarfreader& reader, size_t i);
+
+		/// Offset of the unit DIE.
+		uint64_t first() const;
+		uint16_t version() const;
+		/// Signature of a type unit and the offset of its type, false for
+		/// other units.
+		bool type_unit(uint64_t& signature, uint64_t& type_offset) const;
+
+		/// Decodes the DIE at 'at' and moves 'at' past its attributes: to
+		/// its first child if it has children, to its next sibling
+		/// otherwise. Returns false at the end of the unit or on broken
+		/// data.
+		bool next(uint64_t& at, die& d) const;
+		/// Moves 'at' from the first child of 'd' past all its children.
+		bool skip_children(const die& d, uint64_t& at) const;
+
+		/// Reads attributes of a DIE one by one.
+		class attributes {
+		public:
+			attributes(const unit& u, const die& d) :
+				_unit(&u), _die(&d), _i(0), _at(d.attrs) {};
+			bool next(attribute& a);
+		private:
+			const unit *_unit;
+			const die *_die;
+			uint32_t _i;
+			const unsigned char *_at;
+		};
+
+		/// DW_AT_comp_dir of the unit DIE, empty if there is none.
+		const char *comp_dir() const { return _comp_dir; }
+
+		/// Full paths of the source files of the line table, the same way
+		/// dwarf_srcfiles() builds them. File numbers of DW_AT_decl_file
+		/// start with 'first': 1 before DWARF 5, 0 since.
+		bool files(std::vector<std::string>& files, unsigned& first) const;
+
+		/// Hash of the DIEs and the line table of the unit, never 0. Strings
+		/// are hashed rather than their offsets and code addresses relative
+		/// to the lowest one of the line table, so a unit the linker only
+		/// moved keeps its fingerprint. Addresses of static storage (@sa
+		/// static_location) are left out, they go to 'statics' in the order
+		/// of the DIEs, 0 for an index out of the address table.
+		uint64_t fingerprint(std::vector<uint64_t> *statics = 0) const;
+
+		/// Rows of the line table, in the order of the line program.
+		class lines {
+		public:
+			explicit lines(const unit& u);
+			bool next(uint64_t& address, uint64_t& line);
+		private:
+			void reset();
+
+			const unsigned char *_at;
+			const unsigned char *_end;
+			unsigned _min_inst;
+			int _line_base;
+			unsigned _line_range;
+			unsigned _opcode_base;
+			const unsigned char *_opcode_lengths;
+			uint64_t _address;
+			int64_t _line;
+		};
+
+	private:
+		friend class dwarfreader;
+		friend class attribute;
+
+		struct line_header_t;
+		bool read_line_header(line_header_t& h) const;
+
+		const dwarfreader *_reader;
+		const header_t *_header;
+		const unsigned char *_begin;	// of the unit in .debug_info
+		const unsigned char *_end;
+		uint64_t _str_offsets;			// DW_AT_str_offsets_base
+		uint64_t _addr_base;			// DW_AT_addr_base
+		uint64_t _stmt_list;			// offset of the line table or ~0
+		const char *_comp_dir;
+	};
+
+private:
+	section_t _sections[SECTIONS];
+	std::vector<uint64_t> _offsets;
+	std::vector<header_t> _headers;
+	std::vector<abbrev_t> _abbrevs;		// of all the tables
+	std::vector<spec_t> _specs;			// attributes of all the abbreviations
+
+	typedef std::unordered_map<uint64_t, std::pair<uint32_t, uint32_t> > tables_t;
+
+	bool read_units(section_id id, tables_t& tables);
+	bool read_abbrevs(uint64_t offset, uint32_t& first, uint32_t& count);
+};
+
+
+struct dwarfreader::spec_t {
+	uint16_t name;
+	uint16_t form;
+	int64_t implicit;	// DW_FORM_implicit_const value
+};
+
+/// Abbreviations of a table are kept by code, unused codes have tag 0.
+struct dwarfreader::abbrev_t {
+	uint32_t tag;
+	bool children;
+	uint32_t specs;		// first in _specs
+	uint32_t count;
+};
+
+struct dwarfreader::header_t {
+	uint64_t offset;	// of the unit in its section
+	uint64_t size;		// with the header
+	uint64_t first;		// offset of the unit DIE from the unit start
+	uint16_t version;
+	uint8_t offset_size;
+	uint8_t address_size;
+	uint8_t section;	// INFO or TYPES
+	uint32_t abbrevs;	// first of the table in _abbrevs
+	uint32_t codes;		// size of the table
+	uint64_t signature;		// of a type unit
+	uint64_t type_offset;	// of the type in a type unit, 0 in other units
+};
+
+
+inline uint64_t dwarfreader::unit::first() const {
+	return _header->first;
+}
+
+
+inline uint16_t dwarfreader::unit::version() const {
+	return _header->version;
+}
+
+
+inline bool dwarfreader::unit::type_unit(uint64_t& signature,
+	uint64_t& type_offset) const {
+	signature = _header->signature;
+	type_offset = _header->type_offset;
+	return 0 != type_offset;
+}
@@ -0,0 +1,55 @@
+/// Program the tests look into, its variables are listed in sample.h.
+/// Built with -DSAMPLE_MAIN it is a program of its own, -DSAMPLE_CHANGED
+/// adds a variable.
+///
+#include "sample.h"
+
+sample_table_t sample_table;
+sample_alias_t sample_tables[2];
+sample_node sample_root;
+int32_t sample_counter;
+#ifdef SAMPLE_CHANGED
+// The data of the units linked after this one moves (@sa sample_unit.cpp).
+int32_t sample_added[64];
+#endif // SAMPLE_CHANGED
+const char *const sample_source = __FILE__;
+
+static int32_t step(sample_table_t *t, int i) {
+	static int32_t calls;
+	sample_slot *s = &t->slots[i % 8];
+	s->value += i;
+	++calls;
+	return s->value + calls;
+}
+
+int sample_run(int rounds) {
+	int32_t local = 0;
+	for (int i = 0; i < rounds; ++i) {
+		sample_table_t *t = &sample_tables[i % 2];
+		local += step(t, i);
+		{
+			sample_value v;
+			v.whole = local;
+			t->last = v;
+			sample_node n;
+			n.parent = &sample_root;
+			n.payload[0] = v;
+			n.id = i;
+			local += n.id;
+		}
+		{
+			int32_t v = t->grid[i % 3][i % 4];
+			local += v;
+		}
+	}
+	sample_table.next = &sample_tables[0];
+	sample_counter += local;
+	return local;
+}
+
+#ifdef SAMPLE_MAIN
+int main(int argc, char *argv[]) {
+	(void)argv;
+	return sample_run(argc) & 1;
+}
+#endif // SAMPLE_MAIN
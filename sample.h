@@ -0,0 +1,65 @@
+/// Program the tests look into (@sa stress.cpp, crosscheck.cpp): nested
+/// structures, arrays, bit fields, unions, typedef chains and pointers,
+/// globals, statics and locals shadowed in nested blocks.
+///
+#pragma once
+#include <stdint.h>
+
+struct sample_header {
+	uint16_t kind;
+	uint16_t flags : 4;
+	uint16_t level : 12;
+	uint32_t size;
+};
+
+struct sample_slot {
+	uint64_t key;
+	int32_t value;
+	char tag[4];
+};
+
+union sample_value {
+	double real;
+	int64_t whole;
+	char bytes[8];
+};
+
+struct sample_table {
+	struct sample_header hdr;
+	struct sample_slot slots[8];
+	union sample_value last;
+	struct sample_table *next;
+	int32_t grid[3][4];
+};
+
+typedef struct sample_table sample_table_t;
+typedef sample_table_t sample_alias_t;
+
+class sample_base {
+public:
+	int32_t id;
+	struct sample_header hdr;
+};
+
+class sample_node : public sample_base {
+public:
+	sample_node *parent;
+	sample_value payload[2];
+};
+
+extern sample_table_t sample_table;
+extern sample_alias_t sample_tables[2];
+extern sample_node sample_root;
+extern int32_t sample_counter;
+
+/// The source file of sample.cpp as it is compiled (absolute).
+extern const char *const sample_source;
+
+int sample_run(int rounds);
+
+/// Names of the variables of sample.cpp and a name of none.
+static const char *const sample_names[] = {
+	"sample_table", "sample_tables", "sample_root", "sample_counter",
+	"t", "s", "v", "n", "i", "calls", "rounds", "local", "sample_added",
+	"missing"
+};
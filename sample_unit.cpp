@@ -0,0 +1,20 @@
+/// Units linked to sample.cpp for the reload check of crosscheck.cpp, each
+/// built with -DSAMPLE_UNIT=<n>: the variables are named as in sample.h,
+/// the function and the size of the static array differ by unit.
+///
+#include "sample.h"
+
+#define SAMPLE_CONCAT(a, b) a ## b
+#define SAMPLE_FUNCTION(n) SAMPLE_CONCAT(sample_unit, n)
+
+static sample_slot calls[SAMPLE_UNIT + 1];
+
+int SAMPLE_FUNCTION(SAMPLE_UNIT)(int rounds) {
+	int32_t local = 0;
+	for (int i = 0; i < rounds; ++i) {
+		sample_slot *s = &calls[i % (SAMPLE_UNIT + 1)];
+		s->value += i;
+		local += s->value;
+	}
+	return local;
+}
@@ -7,15 +7,284 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <cstdio>
 #include "scoping.h"
 
+#ifdef __linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // __linux
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCOPING_X86
+#include <immintrin.h>
+#endif
+
 namespace {
-	struct tri_t {
-			static tri_t *const make(int level, int start, int end) { return new tri_t(level, start, end); }
-			int _level, _start, _end;
-		private:
-			tri_t(int level, int start, int end) : _level(level), _start(start), _end(end) {};
-		};
+	// Matches brackets with a stack of the scopes being open, the file
+	// scope is open from the start.
+	struct matcher {
+		matcher() : _lineno(1) {
+			_scopes.push_back(std::make_pair(1, int(scoping::NO_END_LINE)));
+			_open.push_back(0);
+		}
+
+		// Handles a bracket or a new line, false if the bracket
+		// can't be matched.
+		bool on(char c) {
+			if ('\n' == c) {
+				++_lineno;
+			} else if ('{' == c) {
+				_open.push_back(_scopes.size());
+				_scopes.push_back(std::make_pair(_lineno, int(scoping::NO_END_LINE)));
+			} else {
+				if (_open.empty()) {
+					printf("Closing bracked without opening one in line %d\n", _lineno);
+					assert(false && "Closing bracket without opening bracket");
+					return false;
+				}
+				_scopes[_open.back()].second = _lineno;
+				_open.pop_back();
+			}
+			return true;
+		}
+
+		// Stores the scopes, the file scope ends at the last line.
+		void finish(const char *text, size_t size, scoping::scope_t& out) {
+			int lines = _lineno;
+			if (0 == size || '\n' == text[size - 1])
+				--lines;
+			_scopes[0].second = lines;
+			// Later scopes starting at the same line win.
+			for (auto &i : _scopes)
+				out[i.first] = i.second;
+		}
+
+		// Number of brackets left open, but the file scope.
+		size_t unclosed() const {
+			return _open.empty() ? 0 : _open.size() - 1;
+		}
+
+	private:
+		int _lineno;
+		std::vector<std::pair<int, int> > _scopes;	// start, end lines
+		std::vector<size_t> _open;		// indexes of the open scopes
+	};
+
+	inline bool interesting(char c) {
+		return '{' == c || '}' == c || '\n' == c;
+	}
+
+	bool scan_scalar(const char *text, size_t size, matcher& m) {
+		for (size_t i = 0; i < size; ++i) {
+			if (interesting(text[i]) && !m.on(text[i]))
+				return false;
+		}
+		return true;
+	}
+
+#ifdef SCOPING_X86
+	// Feeds bytes of the block which bits are set in the mask.
+	inline bool scan_mask(const char *block, unsigned mask, matcher& m) {
+		while (0 != mask) {
+			if (!m.on(block[__builtin_ctz(mask)]))
+				return false;
+			mask &= mask - 1;
+		}
+		return true;
+	}
+
+	__attribute__((target("sse2")))
+	bool scan_sse2(const char *text, size_t size, matcher& m) {
+		const __m128i open = _mm_set1_epi8('{');
+		const __m128i close = _mm_set1_epi8('}');
+		const __m128i nl = _mm_set1_epi8('\n');
+		size_t i = 0;
+		for (; i + 16 <= size; i += 16) {
+			const __m128i v = _mm_loadu_si128((const __m128i *)(text + i));
+			const __m128i hits = _mm_or_si128(_mm_or_si128(
+				_mm_cmpeq_epi8(v, open), _mm_cmpeq_epi8(v, close)),
+				_mm_cmpeq_epi8(v, nl));
+			if (!scan_mask(text + i, _mm_movemask_epi8(hits), m))
+				return false;
+		}
+		return scan_scalar(text + i, size - i, m);
+	}
+
+	__attribute__((target("avx2")))
+	bool scan_avx2(const char *text, size_t size, matcher& m) {
+		const __m256i open = _mm256_set1_epi8('{');
+		const __m256i close = _mm256_set1_epi8('}');
+		const __m256i nl = _mm256_set1_epi8('\n');
+		size_t i = 0;
+		for (; i + 32 <= size; i += 32) {
+			const __m256i v = _mm256_loadu_si256((const __m256i *)(text + i));
+			const __m256i hits = _mm256_or_si256(_mm256_or_si256(
+				_mm256_cmpeq_epi8(v, open), _mm256_cmpeq_epi8(v, close)),
+				_mm256_cmpeq_epi8(v, nl));
+			if (!scan_mask(text + i, _mm256_movemask_epi8(hits), m))
+				return false;
+		}
+		return scan_scalar(text + i, size - i, m);
+	}
+#endif // SCOPING_X86
+
+	scoping::scan_t best_scan() {
+#ifdef SCOPING_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return scoping::SCAN_AVX2;
+		if (__builtin_cpu_supports("sse2"))
+			return scoping::SCAN_SSE2;
+#endif // SCOPING_X86
+		return scoping::SCAN_SCALAR;
+	}
+
+	bool scan(const char *text, size_t size, matcher& m, scoping::scan_t how) {
+		static const scoping::scan_t best = best_scan();
+		if (scoping::SCAN_BEST == how || how > best)
+			how = best;
+		switch (how) {
+#ifdef SCOPING_X86
+		case scoping::SCAN_AVX2: return scan_avx2(text, size, m);
+		case scoping::SCAN_SSE2: return scan_sse2(text, size, m);
+#endif // SCOPING_X86
+		default: return scan_scalar(text, size, m);
+		}
+	}
+
+	// Contents of a file, mapped to memory where possible.
+	class text_file {
+	public:
+		explicit text_file(const std::string& path) :
+			_text(0), _size(0), _opened(false) {
+#ifdef __linux
+			const int fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				return;
+			struct stat st;
+			if (0 == fstat(fd, &st) && S_ISREG(st.st_mode)) {
+				_opened = true;
+				_size = st.st_size;
+				if (0 != _size) {
+					void *const p = mmap(0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+					if (MAP_FAILED == p)
+						_opened = false;
+					else
+						_text = (const char *)p;
+				}
+			}
+			close(fd);
+#else
+			std::ifstream fstream(path.c_str(), std::ios::binary);
+			if (!fstream.is_open())
+				return;
+			std::ostringstream contents;
+			contents << fstream.rdbuf();
+			_buffer = contents.str();
+			_text = _buffer.data();
+			_size = _buffer.size();
+			_opened = true;
+#endif // __linux
+		}
+		~text_file() {
+#ifdef __linux
+			if (!!_text)
+				munmap((void *)_text, _size);
+#endif // __linux
+		}
+
+		bool opened() const { return _opened; }
+		const char *text() const { return _text; }
+		size_t size() const { return _size; }
+
+	private:
+		text_file(const text_file&);
+		text_file& operator=(const text_file&);
+
+		const char *_text;
+		size_t _size;
+		bool _opened;
+#ifndef __linux
+		std::string _buffer;
+#endif // __linux
+	};
+
+	// Reads scopes of the file into 'out'.
+	bool read_scopes(const std::string& file_path, scoping::scope_t& out,
+		size_t& size) {
+		text_file file(file_path);
+		size = file.size();
+		if (!file.opened()) {
+			printf("Scoping: cannot open file %s\n", file_path.c_str());
+			return true;
+		}
+		matcher m;
+		if (!scan(file.text(), file.size(), m, scoping::SCAN_BEST))
+			return false;
+		if (0 != m.unclosed()) {
+			printf("Not balanced brackets in file %s\n", file_path.c_str());
+			printf("Number of not balanced brackets is: %d\n",
+				(int)m.unclosed());
+			printf("There can be incorrect scoping in file %s\n", file_path.c_str());
+		}
+		m.finish(file.text(), file.size(), out);
+		return true;
+	}
+}
+
+
+bool scoping::parse(const char *text, size_t size, scope_t& scopes,
+	scan_t scan_with) {
+	matcher m;
+	if (!scan(text, size, m, scan_with))
+		return false;
+	m.finish(text, size, scopes);
+	return true;
+}
+
+
+bool scoping::supported(scan_t scan) {
+	static const scan_t best = best_scan();
+	return SCAN_BEST == scan || scan <= best;
+}
+
+
+const scoping::scope_t& scoping::cache::get(const std::string& file_path) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto i = _files.find(file_path);
+		if (_files.end() != i)
+			return i->second;
+	}
+	// The file is read unlocked, if another thread reads it meanwhile
+	// the first result is kept (they are the same anyway).
+	scope_t scopes;
+	size_t size = 0;
+	const auto start = std::chrono::steady_clock::now();
+	read_scopes(file_path, scopes, size);
+	const std::chrono::duration<double> spent =
+		std::chrono::steady_clock::now() - start;
+	std::lock_guard<std::mutex> lock(_mutex);
+	++_stats.files;
+	_stats.bytes += size;
+	_stats.scopes += scopes.size();
+	_stats.seconds += spent.count();
+	return _files.insert(std::make_pair(file_path, scopes)).first->second;
+}
+
+
+void scoping::cache::clear() {
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::map<std::string, scope_t>().swap(_files);
+}
+
+
+scoping::cache::stats_t scoping::cache::stats() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stats;
 }
 
 
@@ -23,11 +292,7 @@ bool scoping::init(const std::vector<std::string>& srcfiles, const std::string&
 	_scopes.clear();
 	_path_prefix = paths_prefix;
 	static const std::string built_in = "<built-in>";
-	std::vector<tri_t*> scopes;
 	for (const std::string& f : srcfiles) {
-		std::ifstream fstream;
-		scopes.clear();
-	
 		std::string file_path;
 		if ('/' != f[0])
 			file_path = _path_prefix;
@@ -35,59 +300,7 @@ bool scoping::init(const std::vector<std::string>& srcfiles, const std::string&
 		if (0 == file_path.compare(file_path.size() - built_in.size(),
 			built_in.size(), built_in.c_str()))
 			continue;
-		fstream.open(file_path.c_str());
-		if (!fstream.is_open()) {
-			
-			printf("Scoping: cannot open file %s\n", file_path.c_str());
-			continue;
-		}
-		int nesting_level = 0;
-		int lineno = 0;
-		struct look_for_empty_end_of_nesting_level {
-			look_for_empty_end_of_nesting_level(int level) : _level(level) {};
-			bool operator() (tri_t *& item) { return item->_level == _level && NO_END_LINE == item->_end; }
-		private:
-			const int _level;
-		};
-
-		scopes.push_back(tri_t::make(nesting_level, 1, NO_END_LINE));
-		++nesting_level;
-		std::string line;
-
-		while(std::getline(fstream, line)) {
-			++lineno;
-			for (unsigned i = 0; i < line.size(); ++i) {
-				if ('{' == line[i]) {
-					scopes.push_back(tri_t::make(nesting_level, lineno, NO_END_LINE));
-					++nesting_level;
-				}
-				else if ('}' == line[i]) {
-					--nesting_level;
-					auto item = std::find_if(scopes.begin(), scopes.end(), look_for_empty_end_of_nesting_level(nesting_level));
-					if (scopes.end() == item) {
-						printf("Closing bracked without opening one in line %d\n", lineno);
-						assert(false && "Closing bracket without opening bracket");
-						return false;
-					}
-					(*item)->_end = lineno;
-				}
-			}
-		}
-		if (1 != nesting_level) {
-			printf("Not balanced brackets in file %s\n", f.c_str());
-			printf("Number of not balanced brackets is: %d\n",
-				nesting_level - 1);
-			printf("There can be incorrect scoping in file %s\n", f.c_str());
-		}
-		//assert(1 == nesting_level && "Not balanced brackets");
-		--nesting_level;
-		scopes[0]->_end = lineno;
-		fstream.close();
-
-		for (auto &i : scopes) {
-			_scopes[file_path][i->_start] = i->_end;
-			delete i;
-		}
+		_scopes[file_path] = &_cache->get(file_path);
 	}
 	return true;
 }
@@ -4,25 +4,71 @@
 /// Sep - 2014, Nik Zaborovsky
 #pragma once
 #include <map>
+#include <chrono>
 #include <string>
 #include <vector>
+#include <mutex>
 #include <cassert>
+#include <cstddef>
 
 
 struct scoping {
 	enum {NO_END_LINE = -1};
+	typedef std::map<int, int> scope_t;
+
+	/// Scopes of all the files read so far. Every file is read only
+	/// the first time it is met, so headers shared by many units are
+	/// read once. Can be shared by scopings used from different threads.
+	class cache {
+	public:
+		/// Files read by the cache, the counts stay after clear().
+		struct stats_t {
+			stats_t() : files(0), bytes(0), scopes(0), seconds(0) {};
+			size_t files;
+			size_t bytes;
+			size_t scopes;
+			double seconds;		// reading and parsing, summed over threads
+		};
+
+		/// Scopes of the file, the reference stays valid while
+		/// the cache lives.
+		const scope_t& get(const std::string& file_path);
+		/// Drops all the scopes, the references given out become invalid.
+		void clear();
+		stats_t stats() const;
+	private:
+		mutable std::mutex _mutex;
+		std::map<std::string, scope_t> _files;
+		stats_t _stats;
+	};
+
+	/// Byte scanners looking for brackets and new lines.
+	enum scan_t {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2, SCAN_BEST};
+
+	/// Parses scopes of the text into 'scopes' with the given scanner,
+	/// SCAN_BEST is the fastest one the CPU supports. Returns false if
+	/// there is a closing bracket without an opening one.
+	static bool parse(const char *text, size_t size, scope_t& scopes,
+		scan_t scan = SCAN_BEST);
+	/// Whether the CPU supports the scanner.
+	static bool supported(scan_t scan);
+
+	/// Scopes are kept in 'shared' if it is given, or in own cache.
+	explicit scoping(cache *const shared = 0) :
+		_cache(!!shared ? shared : &_own_cache) {};
+
 	bool init(const std::vector<std::string>& /*srcfiles*/,
 		const std::string& paths_prefix = std::string());
 	int endline(const std::string& file, int startline) const {
-		assert(scope_t() != _scopes.at(file) && "Scoping: no file");
-		if (0 == _scopes.at(file).at(startline))
+		assert(scope_t() != *_scopes.at(file) && "Scoping: no file");
+		if (0 == _scopes.at(file)->at(startline))
 			return NO_END_LINE;
-		return _scopes.at(file).at(startline);
+		return _scopes.at(file)->at(startline);
 	}
 	// 'scope' is a lexical scope which includes declline and which
 	// left end is the closest to the declaration of all file scopes.
 	std::pair<int, int> scope(const std::string& file, int declline) {
-		const scope_t& sc = _scopes[file];
+		const scope_t& sc = scopes(file);
 		for(auto i = sc.rbegin(); sc.rend() != i; ++i) {
 			if (i->first > declline || i->second < declline) continue;
 			return *i;
@@ -31,7 +77,7 @@ struct scoping {
 	}
 
 	int nextScope(const std::string& file, int line) {
-		const scope_t& sc = _scopes[file];
+		const scope_t& sc = scopes(file);
 		for (auto i = sc.begin(); sc.end() != i; ++i) {
 			if (i->first >= line)
 			return i->first;
@@ -39,7 +85,15 @@ struct scoping {
 		return 0;
 	}
 private:
-	typedef std::map<int, int> scope_t;
-	std::map<std::string, scope_t> _scopes;
+	// Scopes of a file of the last 'init', empty for other files.
+	const scope_t& scopes(const std::string& file) const {
+		static const scope_t no_scopes;
+		auto i = _scopes.find(file);
+		return _scopes.end() == i ? no_scopes : *i->second;
+	}
+
+	cache _own_cache;
+	cache *const _cache;
+	std::map<std::string, const scope_t*> _scopes;
 	std::string _path_prefix;
 };
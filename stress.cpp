@@ -0,0 +1,267 @@
+/// Concurrent queries of one VarInfo: threads ask it at once by strings,
+/// by handles, in batches (resolve()) and by addresses (symbolize()), and
+/// every answer is compared to the one a single thread got from another
+/// VarInfo, built eagerly. The program looks into itself, the variables are
+/// those of sample.cpp. Makefile.stress builds it and the library with
+/// -fsanitize=thread, so races are reported as well.
+///
+/// Usage: stress [-t threads] [-r rounds] [-L] [-N] [-R]
+///   -L - the lazy mode: the racing queries load the units
+///   -N - the built-in DWARF reader
+///   -R - one more thread reloads the program over and over meanwhile,
+///        keeping the units (VarInfo::Options::incremental)
+///
+/// The exit code is 1 if any answer differs.
+
+#include <link.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <atomic>
+#include <thread>
+
+#include "varinfo.hpp"
+#include "sample.h"
+
+namespace {
+	struct query_t {
+		size_t line;
+		const char *name;
+		unsigned offset;
+		std::string type;	// answers of the single thread
+		std::string field;
+	};
+
+	struct address_t {
+		uint64_t address;	// as the program is linked
+		std::string symbol;	// @sa describe
+	};
+
+	enum {MAX_OFFSET = 48, OFFSET_STEP = 5, BATCH = 64, MAX_REPORTS = 10,
+		RELOADS = 4};
+
+	std::atomic<size_t> mismatches(0);
+	std::atomic<size_t> asked(0);
+	std::atomic<bool> reloading(false);	// queries go on till the reloads end
+
+	void mismatch(const char *what, const std::string& expected,
+		const std::string& got) {
+		if (mismatches++ < MAX_REPORTS)
+			fprintf(stderr, "%s: expected \"%s\", got \"%s\"\n", what,
+				expected.c_str(), got.c_str());
+	}
+
+	// Load bias of the program, DWARF has the addresses it is linked at.
+	int program_bias(struct dl_phdr_info *info, size_t, void *data) {
+		*(uint64_t *)data = info->dlpi_addr;
+		return 1;
+	}
+
+	std::string describe(const VarInfo& vi, const uint64_t address,
+		unsigned *generation = 0) {
+		VarInfo::Symbol s;
+		if (!vi.symbolize(address, s))
+			return "<none>";
+		if (!!generation)
+			*generation = s.result.generation;
+		return vi.text(s.name) + ':' + std::to_string(s.line) + '+' +
+			std::to_string(s.offset) + ' ' + vi.result_type(s.result) + ' ' +
+			vi.result_fieldname(s.result);
+	}
+
+	size_t count_lines(const char *path) {
+		std::ifstream in(path);
+		std::string line;
+		size_t lines = 0;
+		while (std::getline(in, line))
+			++lines;
+		return lines;
+	}
+
+	// Each thread goes through the queries in an order of its own, every
+	// fourth one is asked each way, the rounds are repeated while reloading.
+	void query(const VarInfo& vi, const std::vector<query_t>& queries,
+		const std::vector<address_t>& addresses, const unsigned seed,
+		const unsigned rounds) {
+
+		// Loads the units of the file in the lazy mode, before symbolize()
+		// may find its variables.
+		const VarInfo::handle_t file = vi.file_handle(sample_source);
+		std::vector<VarInfo::Query> batch;
+		std::vector<const query_t*> batched;
+		unsigned r = seed;
+		size_t k = 0;
+		for (; k < rounds * queries.size() || reloading; ++k) {
+			r = r * 1103515245 + 12345;
+			const query_t& q = queries[(r >> 8) % queries.size()];
+			switch (k % 4) {
+			case 0:
+				if (vi.type(sample_source, q.line, q.name) != q.type)
+					mismatch("type", q.type, vi.type(sample_source, q.line, q.name));
+				if (vi.fieldname(sample_source, q.line, q.name, q.offset) != q.field)
+					mismatch("fieldname", q.field,
+						vi.fieldname(sample_source, q.line, q.name, q.offset));
+				break;
+			case 1: {
+				const VarInfo::handle_t name = vi.name_handle(q.name);
+				if (vi.type(file, q.line, name) != q.type)
+					mismatch("type by handles", q.type, vi.type(file, q.line, name));
+				if (vi.fieldname(file, q.line, name, q.offset) != q.field)
+					mismatch("fieldname by handles", q.field,
+						vi.fieldname(file, q.line, name, q.offset));
+				break;
+			}
+			case 2: {
+				VarInfo::Query b;
+				b.file = file;
+				b.line = q.line;
+				b.name = vi.name_handle(q.name);
+				b.offset = q.offset;
+				batch.push_back(b);
+				batched.push_back(&q);
+				if (batch.size() < BATCH)
+					break;
+				std::vector<VarInfo::Result> results(batch.size());
+				vi.resolve(&batch[0], batch.size(), &results[0], 1 + seed % 2);
+				for (size_t i = 0; i < batch.size(); ++i) {
+					if (vi.result_type(results[i]) != batched[i]->type)
+						mismatch("resolve type", batched[i]->type, vi.result_type(results[i]));
+					std::string field = vi.result_fieldname(results[i]);
+					// Fields of results of the data base a reload replaced
+					// are unknown, the current one is asked then.
+					if (field != batched[i]->field) {
+						VarInfo::Result again;
+						vi.resolve(&batch[i], 1, &again);
+						if (again.generation != results[i].generation)
+							field = vi.result_fieldname(again);
+					}
+					if (field != batched[i]->field)
+						mismatch("resolve field", batched[i]->field, field);
+				}
+				batch.clear();
+				batched.clear();
+				break;
+			}
+			default: {
+				const address_t& a = addresses[(r >> 4) % addresses.size()];
+				unsigned generation = 0, now = 0;
+				std::string symbol = describe(vi, a.address, &generation);
+				if (symbol != a.symbol) {
+					const std::string again = describe(vi, a.address, &now);
+					if (now != generation)
+						symbol = again;
+				}
+				if (symbol != a.symbol)
+					mismatch("symbolize", a.symbol, symbol);
+				break;
+			}
+			}
+		}
+		asked += k;
+	}
+
+	void reload(VarInfo& vi) {
+		for (int i = 0; i < RELOADS; ++i) {
+			if (!vi.reload())
+				mismatch("reload", "true", "false");
+		}
+		reloading = false;
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	unsigned threads = 8, rounds = 4;
+	VarInfo::Options options;
+	for (int c; -1 != (c = getopt(argc, argv, "t:r:LNR"));) {
+		switch (c) {
+		case 't': threads = atoi(optarg); break;
+		case 'r': rounds = atoi(optarg); break;
+		case 'L': options.lazy = true; break;
+		case 'N': options.native = true; break;
+		case 'R': reloading = options.incremental = true; break;
+		default:
+			fprintf(stderr, "Usage: %s [-t threads] [-r rounds] [-L] [-N] [-R]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	VarInfo::Options eager;
+	eager.native = options.native;
+	VarInfo expected;
+	if (!expected.init("/proc/self/exe", eager)) {
+		fprintf(stderr, "Failed to read the program\n");
+		return 1;
+	}
+	std::vector<query_t> queries;
+	size_t known = 0;
+	const size_t lines = count_lines(sample_source);
+	for (size_t line = 1; line <= lines; ++line) {
+		for (size_t n = 0; n < sizeof(sample_names) / sizeof(*sample_names); ++n) {
+			query_t q;
+			q.line = line;
+			q.name = sample_names[n];
+			q.type = expected.type(sample_source, line, q.name);
+			known += "<Unknown>" != q.type;
+			for (q.offset = 0; q.offset < MAX_OFFSET; q.offset += OFFSET_STEP) {
+				q.field = expected.fieldname(sample_source, line, q.name, q.offset);
+				queries.push_back(q);
+			}
+		}
+	}
+	uint64_t bias = 0;
+	dl_iterate_phdr(program_bias, &bias);
+	const struct {
+		const void *data;
+		size_t size;
+	} globals[] = {
+		{&sample_table, sizeof(sample_table)},
+		{&sample_tables, sizeof(sample_tables)},
+		{&sample_root, sizeof(sample_root)},
+		{&sample_counter, sizeof(sample_counter)}
+	};
+	std::vector<address_t> addresses;
+	size_t found = 0;
+	for (size_t g = 0; g < sizeof(globals) / sizeof(*globals); ++g) {
+		const uint64_t begin = uint64_t(globals[g].data) - bias;
+		for (uint64_t a = begin - 4; a < begin + globals[g].size + 4; ++a) {
+			address_t address;
+			address.address = a;
+			address.symbol = describe(expected, a);
+			found += "<none>" != address.symbol;
+			addresses.push_back(address);
+		}
+	}
+	if (0 == known || 0 == found) {
+		fprintf(stderr, "No variables of %s are found\n", sample_source);
+		return 1;
+	}
+
+	VarInfo vi;
+	if (!vi.init("/proc/self/exe", options)) {
+		fprintf(stderr, "Failed to read the program\n");
+		return 1;
+	}
+	std::vector<std::thread> workers;
+	for (unsigned t = 0; t < threads; ++t) {
+		workers.push_back(std::thread(query, std::cref(vi), std::cref(queries),
+			std::cref(addresses), t + 1, rounds));
+	}
+	const bool reloads = reloading;
+	std::thread reloader;
+	if (reloads)
+		reloader = std::thread(reload, std::ref(vi));
+	for (auto w = workers.begin(); workers.end() != w; ++w)
+		w->join();
+	if (reloads)
+		reloader.join();
+
+	printf("%u threads, %zu queries, %zu addresses, %d reloads: %zu mismatches\n",
+		threads, size_t(asked), addresses.size(), reloads ? int(RELOADS) : 0,
+		size_t(mismatches));
+	return 0 == mismatches ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+/// Flat index of variables and their types.
+///
+#include <string.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "varindex.h"
+
+#ifdef __linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // __linux
+
+namespace {
+	// Also tells the byte order the index is written in.
+	const uint64_t MAGIC = 0x31584449524156ull;	// "VARIDX1"
+	// Bumped on every change of the layout.
+	const uint32_t VERSION = 3;
+
+	enum {
+		SEC_KEY,
+		SEC_STRINGS,
+		SEC_CHARS,
+		SEC_HASH,
+		SEC_RANGES,
+		SEC_TYPES,
+		SEC_FIELDS,
+		SEC_SYMBOLS,
+		SECTIONS
+	};
+
+	uint64_t hash_bytes(const char *s, size_t size) {
+		uint64_t h = 14695981039346656037ull;	// FNV-1a
+		for (size_t i = 0; i < size; ++i) {
+			h ^= (unsigned char)s[i];
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
+
+	uint64_t checksum(const uint64_t *words, size_t count) {
+		uint64_t h = 14695981039346656037ull;
+		for (size_t i = 0; i < count; ++i) {
+			h ^= words[i];
+			h *= 1099511628211ull;
+			h ^= h >> 29;
+		}
+		return h;
+	}
+
+	inline size_t align8(size_t size) {
+		return (size + 7) & ~size_t(7);
+	}
+}
+
+
+struct varindex::string_t {
+	uint64_t offset;	// in SEC_CHARS
+	uint64_t size;
+};
+
+struct varindex::section_t {
+	uint64_t offset;	// from the start of the index
+	uint64_t count;		// of records
+};
+
+struct varindex::header_t {
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	reserved;
+	uint64_t	size;		// of the whole index
+	uint64_t	checksum;	// of everything after the header
+	section_t	sections[SECTIONS];
+};
+
+
+uint32_t varindex::builder::intern(const std::string& s) {
+	auto i = _ids.find(s);
+	if (_ids.end() != i)
+		return i->second;
+	const uint32_t id = _strs.size();
+	i = _ids.insert(std::make_pair(s, id)).first;
+	_strs.push_back(&i->first);
+	return id;
+}
+
+
+varindex::varindex() : _mapped(0) {
+	release();
+}
+
+
+varindex::~varindex() {
+	release();
+}
+
+
+void varindex::release() {
+#ifdef __linux
+	if (!!_mapped)
+		munmap(_mapped, _size);
+#endif // __linux
+	_mapped = 0;
+	std::vector<uint64_t>().swap(_buffer);
+	_size = 0;
+	_header = 0;
+	_strings = 0;
+	_nstrings = 0;
+	_chars = 0;
+	_hash = 0;
+	_hash_size = 0;
+	_ranges = 0;
+	_nranges = 0;
+	_types = 0;
+	_ntypes = 0;
+	_fields = 0;
+	_nfields = 0;
+	_symbols = 0;
+	_nsymbols = 0;
+}
+
+
+void varindex::build(const builder& b, const std::string& key) {
+	release();
+
+	size_t chars = 0;
+	for (auto s = b._strs.begin(); b._strs.end() != s; ++s)
+		chars += (*s)->size();
+	size_t hash_size = 1;
+	while (hash_size < 2 * b._strs.size())
+		hash_size *= 2;
+
+	section_t sections[SECTIONS];
+	const size_t sizes[SECTIONS] = {
+		key.size(),
+		b._strs.size() * sizeof(string_t),
+		chars,
+		hash_size * sizeof(uint32_t),
+		b.ranges.size() * sizeof(range_t),
+		b.types.size() * sizeof(type_t),
+		b.fields.size() * sizeof(field_t),
+		b.symbols.size() * sizeof(symbol_t),
+	};
+	const size_t counts[SECTIONS] = {
+		key.size(), b._strs.size(), chars, hash_size,
+		b.ranges.size(), b.types.size(), b.fields.size(), b.symbols.size(),
+	};
+	size_t size = sizeof(header_t);
+	for (int s = 0; s < SECTIONS; ++s) {
+		sections[s].offset = size;
+		sections[s].count = counts[s];
+		size += align8(sizes[s]);
+	}
+
+	_buffer.assign(size / sizeof(uint64_t), 0);
+	char *const image = (char *)&_buffer[0];
+	header_t *const header = (header_t *)image;
+	header->magic = MAGIC;
+	header->version = VERSION;
+	header->size = size;
+	memcpy(header->sections, sections, sizeof(sections));
+
+	if (!key.empty())
+		memcpy(image + sections[SEC_KEY].offset, key.data(), key.size());
+
+	string_t *const strings = (string_t *)(image + sections[SEC_STRINGS].offset);
+	char *const text = image + sections[SEC_CHARS].offset;
+	uint32_t *const hash = (uint32_t *)(image + sections[SEC_HASH].offset);
+	for (size_t i = 0; i < hash_size; ++i)
+		hash[i] = NONE;
+	uint64_t offset = 0;
+	for (size_t id = 0; id < b._strs.size(); ++id) {
+		const std::string& s = *b._strs[id];
+		strings[id].offset = offset;
+		strings[id].size = s.size();
+		if (!s.empty())
+			memcpy(text + offset, s.data(), s.size());
+		offset += s.size();
+		size_t slot = hash_bytes(s.data(), s.size()) & (hash_size - 1);
+		while (NONE != hash[slot])
+			slot = (slot + 1) & (hash_size - 1);
+		hash[slot] = id;
+	}
+
+	if (!b.ranges.empty())
+		memcpy(image + sections[SEC_RANGES].offset, &b.ranges[0], sizes[SEC_RANGES]);
+	if (!b.types.empty())
+		memcpy(image + sections[SEC_TYPES].offset, &b.types[0], sizes[SEC_TYPES]);
+	if (!b.fields.empty())
+		memcpy(image + sections[SEC_FIELDS].offset, &b.fields[0], sizes[SEC_FIELDS]);
+	if (!b.symbols.empty())
+		memcpy(image + sections[SEC_SYMBOLS].offset, &b.symbols[0], sizes[SEC_SYMBOLS]);
+
+	header->checksum = checksum(&_buffer[sizeof(header_t) / sizeof(uint64_t)],
+		(size - sizeof(header_t)) / sizeof(uint64_t));
+	attach(image, size);
+}
+
+
+bool varindex::open(const std::string& path, const std::string& key) {
+	release();
+#ifdef __linux
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void *image = MAP_FAILED;
+	if (0 == fstat(fd, &st) && size_t(st.st_size) >= sizeof(header_t))
+		image = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == image)
+		return false;
+	_mapped = image;
+	_size = st.st_size;
+#else
+	std::ifstream fstream(path.c_str(), std::ios::binary);
+	if (!fstream.is_open())
+		return false;
+	std::ostringstream contents;
+	contents << fstream.rdbuf();
+	const std::string& s = contents.str();
+	if (s.size() < sizeof(header_t) || 0 != s.size() % sizeof(uint64_t))
+		return false;
+	_buffer.resize(s.size() / sizeof(uint64_t));
+	memcpy(&_buffer[0], s.data(), s.size());
+	_size = s.size();
+	const void *const image = &_buffer[0];
+#endif // __linux
+
+	const header_t *const header = (const header_t *)image;
+	const section_t& k = header->sections[SEC_KEY];
+	if (0 != _size % sizeof(uint64_t) || MAGIC != header->magic ||
+		VERSION != header->version || _size != header->size ||
+		k.offset + k.count > _size || k.count != key.size() ||
+		0 != memcmp((const char *)image + k.offset, key.data(), key.size())) {
+		release();
+		return false;
+	}
+	const uint64_t *const words = (const uint64_t *)image;
+	if (header->checksum != checksum(words + sizeof(header_t) / sizeof(uint64_t),
+		(_size - sizeof(header_t)) / sizeof(uint64_t)) ||
+		!attach(image, _size)) {
+		release();
+		return false;
+	}
+	return true;
+}
+
+
+// Checks that the sections are inside the index and sets them up.
+bool varindex::attach(const void *image, size_t size) {
+	const char *const base = (const char *)image;
+	const header_t *const header = (const header_t *)image;
+	const size_t record_sizes[SECTIONS] = {
+		1, sizeof(string_t), 1, sizeof(uint32_t),
+		sizeof(range_t), sizeof(type_t), sizeof(field_t), sizeof(symbol_t),
+	};
+	for (int s = 0; s < SECTIONS; ++s) {
+		const section_t& sec = header->sections[s];
+		if (sec.offset % sizeof(uint64_t) || sec.offset > size ||
+			sec.count > (size - sec.offset) / record_sizes[s])
+			return false;
+	}
+	const section_t *const sec = header->sections;
+	const size_t hash_size = sec[SEC_HASH].count;
+	if (0 == hash_size || 0 != (hash_size & (hash_size - 1)))
+		return false;
+	_header = header;
+	_strings = (const string_t *)(base + sec[SEC_STRINGS].offset);
+	_nstrings = sec[SEC_STRINGS].count;
+	_chars = base + sec[SEC_CHARS].offset;
+	_hash = (const uint32_t *)(base + sec[SEC_HASH].offset);
+	_hash_size = hash_size;
+	_ranges = (const range_t *)(base + sec[SEC_RANGES].offset);
+	_nranges = sec[SEC_RANGES].count;
+	_types = (const type_t *)(base + sec[SEC_TYPES].offset);
+	_ntypes = sec[SEC_TYPES].count;
+	_fields = (const field_t *)(base + sec[SEC_FIELDS].offset);
+	_nfields = sec[SEC_FIELDS].count;
+	_symbols = (const symbol_t *)(base + sec[SEC_SYMBOLS].offset);
+	_nsymbols = sec[SEC_SYMBOLS].count;
+	_size = size;
+	return true;
+}
+
+
+bool varindex::save(const std::string& path) const {
+	if (!_header)
+		return false;
+	std::ostringstream tmp;
+	tmp << path << ".tmp";
+#ifdef __linux
+	tmp << getpid();
+#endif // __linux
+	FILE *const f = fopen(tmp.str().c_str(), "wb");
+	if (!f)
+		return false;
+	const bool written = 1 == fwrite(_header, _size, 1, f);
+	if (0 != fclose(f) || !written ||
+		0 != rename(tmp.str().c_str(), path.c_str())) {
+		remove(tmp.str().c_str());
+		return false;
+	}
+	return true;
+}
+
+
+uint32_t varindex::find(const std::string& s) const {
+	if (!_header)
+		return NONE;
+	size_t slot = hash_bytes(s.data(), s.size()) & (_hash_size - 1);
+	for (;;) {
+		const uint32_t id = _hash[slot];
+		if (NONE == id || id >= _nstrings)
+			return NONE;
+		if (_strings[id].size == s.size() &&
+			0 == memcmp(_chars + _strings[id].offset, s.data(), s.size()))
+			return id;
+		slot = (slot + 1) & (_hash_size - 1);
+	}
+}
+
+
+std::string varindex::str(uint32_t id) const {
+	if (id >= _nstrings)
+		return std::string();
+	return std::string(_chars + _strings[id].offset, _strings[id].size);
+}
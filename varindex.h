@@ -0,0 +1,146 @@
+/// Flat index of variables and their types. The index is laid out in
+/// a single block of memory without pointers, so it is written to a file
+/// as is and queries are answered right from the mapped file.
+///
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+class varindex {
+public:
+	enum {NONE = ~0u};
+
+	/// Visibility range of a variable, ranges are sorted by
+	/// (file, name, line) (@sa VarInfo::Imp::get_var).
+	struct range_t {
+		uint32_t file;		// string id
+		uint32_t name;		// string id
+		uint32_t line;		// declaration line
+		uint32_t vis_end;	// line where the visibility ends
+		uint32_t enclosing;	// enclosing range of the same variable or NONE
+		uint32_t type;		// type id
+
+		bool operator< (const range_t& r) const {
+			if (file != r.file)
+				return file < r.file;
+			if (name != r.name)
+				return name < r.name;
+			return line < r.line;
+		}
+	};
+
+	/// Flags of a type telling how its fields are laid out.
+	enum {
+		TF_INDIRECT = 1,	// the fields are behind a pointer or a reference
+		TF_POINTERS = 2,	// an array of pointers or references
+	};
+
+	/// Resolved type, 'fields' are positions of its fields sorted by offset.
+	struct type_t {
+		uint32_t spelled;	// string id
+		uint32_t fields;
+		uint32_t nfields;
+		uint32_t flags;		// TF_*
+		uint64_t size;
+		uint64_t count;		// upper bound of an array
+	};
+
+	struct field_t {
+		uint32_t offset;
+		uint32_t name;		// string id
+		uint32_t type;		// type id
+	};
+
+	/// Address range of a variable of static storage, symbols are sorted
+	/// by address.
+	struct symbol_t {
+		uint64_t address;
+		uint64_t size;
+		uint32_t range;		// declaration of the variable
+		uint32_t reserved;
+	};
+
+	/// Collects the contents of an index.
+	class builder {
+	public:
+		uint32_t intern(const std::string& s);
+
+		std::vector<range_t> ranges;
+		std::vector<type_t>	types;
+		std::vector<field_t> fields;
+		std::vector<symbol_t> symbols;
+
+	private:
+		friend class varindex;
+		std::unordered_map<std::string, uint32_t> _ids;
+		std::vector<const std::string*> _strs;	// keys of _ids by id
+	};
+
+	varindex();
+	~varindex();
+
+	/// Lays out the contents of 'b' and uses it, 'key' identifies
+	/// the binary the index is built from.
+	void build(const builder& b, const std::string& key);
+
+	/// Uses the index stored in the file if it is built for 'key'.
+	/// Returns false if the file is missing, stale or corrupt.
+	bool open(const std::string& path, const std::string& key);
+
+	/// Writes the index to the file, the file is replaced atomically.
+	bool save(const std::string& path) const;
+
+	uint32_t find(const std::string& s) const;
+	std::string str(uint32_t id) const;
+	size_t strings_count() const { return _nstrings; }
+
+	const range_t *ranges_begin() const { return _ranges; }
+	const range_t *ranges_end() const { return _ranges + _nranges; }
+	const type_t& type(uint32_t id) const { return _types[id]; }
+	size_t types_count() const { return _ntypes; }
+	const field_t *fields_begin(const type_t& t) const {
+		return _fields + t.fields;
+	}
+	const field_t *fields_end(const type_t& t) const {
+		return _fields + t.fields + t.nfields;
+	}
+	size_t fields_count() const { return _nfields; }
+	const symbol_t *symbols_begin() const { return _symbols; }
+	const symbol_t *symbols_end() const { return _symbols + _nsymbols; }
+
+	/// Size of the index in bytes.
+	size_t size() const { return _size; }
+
+private:
+	varindex(const varindex&);
+	varindex& operator=(const varindex&);
+
+	struct string_t;
+	struct section_t;
+	struct header_t;
+
+	bool attach(const void *image, size_t size);
+	void release();
+
+	std::vector<uint64_t> _buffer;	// built image
+	void		*_mapped;			// mapped image
+	size_t		_size;
+
+	const header_t	*_header;
+	const string_t	*_strings;
+	size_t			_nstrings;
+	const char		*_chars;
+	const uint32_t	*_hash;
+	size_t			_hash_size;
+	const range_t	*_ranges;
+	size_t			_nranges;
+	const type_t	*_types;
+	size_t			_ntypes;
+	const field_t	*_fields;
+	size_t			_nfields;
+	const symbol_t	*_symbols;
+	size_t			_nsymbols;
+};
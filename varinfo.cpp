@@ -17,9 +17,12 @@
 
 #ifdef __linux
 #include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/mman.h>
 #include <libelf.h>
 #include <libdwarf.h>
 #include <gelf.h>
+#include <zlib.h>
 #endif // __linux
 
 #include <cstdio>
@@ -27,12 +30,20 @@
 #include <vector>
 #include <string>
 #include <cassert>
-#include <sstream>
 #include <algorithm>
 #include <map>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
 
 #include "varinfo.hpp"
+#include "varindex.h"
 #include "scoping.h"
+#include "dwarfreader.h"
 
 
 //#define DEBUG_PRINT
@@ -43,739 +54,1269 @@
 #define MY_PRINT(...)
 #endif
 
+const IVarInfo::handle_t IVarInfo::NO_HANDLE;
+
 namespace {
+	enum {NO_TYPE = -1};
+
+	// Kind of a type, modifiers add a suffix to the type they refer to
+	// (@sa type_suffix).
+	enum TypeKind {
+		TK_BASE,
+		TK_POINTER,
+		TK_CONST,
+		TK_REFERENCE,
+		TK_VOLATILE,
+		TK_TYPEDEF,
+		TK_STRUCTURE,
+		TK_CLASS,
+		TK_ARRAY,
+	};
+
+	inline const char *type_suffix(TypeKind kind) {
+		switch (kind) {
+		case TK_POINTER: return "*";
+		case TK_CONST: return " const";
+		case TK_REFERENCE: return "&";
+		case TK_VOLATILE: return " volatile";
+		default: return "";
+		}
+	}
+
 	// BaseTypes describe build-in and derived system data types like
 	// "int", "char", etc. Base types are identified by an offset in
 	//.debug_info section. Offsets are defined per compilation unit.
+	// Types form a graph where modifiers, typedefs and arrays refer to
+	// the type they are based on by 'next' offset.
 	struct basetype_desc {
+		basetype_desc() : offset(0), kind(TK_BASE), size(0), count(0),
+			next(NO_TYPE), id(NO_TYPE) {};
+		size_t offset;	// of the DIE in the unit
+		TypeKind kind;
 		size_t size;
 		size_t count;
 		std::string name;
+		size_t next;	// offset of the referred type or NO_TYPE
+		size_t id;		// resolved type (@sa Types_t)
 	};
 
-	typedef std::map<size_t, basetype_desc> BaseTypesFile_t;
-	typedef std::map<std::string, BaseTypesFile_t> BaseTypes_t;
+	// Base types of a unit sorted by offset, as DIEs are read in the order
+	// of offsets. The deque keeps types in place while it grows.
+	typedef std::deque<basetype_desc> BaseTypesFile_t;
+	typedef std::vector<BaseTypesFile_t> BaseTypes_t; // by CU id
+
+	const basetype_desc *find_type(const BaseTypesFile_t& types,
+		const size_t offset) {
+		auto t = std::lower_bound(types.begin(), types.end(), offset,
+			[](const basetype_desc& bt, size_t o) { return bt.offset < o; });
+		return types.end() == t || t->offset != offset ? 0 : &*t;
+	}
 
-	// int - hash(type offset + file name)
 	auto hasher = std::hash<std::string>();
+
+	// Types are identified by the unit and the offset of the DIE in it.
+	inline uint64_t type_key(const size_t cu, const size_t offset) {
+		return uint64_t(cu) << 32 | uint32_t(offset);
+	}
+
+	// Offsets of DIEs in a unit are below 2 GB. Types of type units
+	// (DW_FORM_ref_sig8) are referred to by SIGNATURE_REF and the number of
+	// the signature among the ones the unit refers to, they are found by
+	// VarInfo::Imp::locate_type.
+	const size_t SIGNATURE_REF = 0x80000000u;
+
+	inline bool is_signature_ref(const size_t offset) {
+		return size_t(NO_TYPE) != offset && (offset & SIGNATURE_REF);
+	}
+
+	// Signatures and offsets of the types of type units by the offsets of
+	// the units (@sa list_units).
+	typedef std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t> > TypeUnits_t;
+
 	struct fieldname_desc {
+		fieldname_desc() : typeoffset(0), type_id(0) {};
 		size_t typeoffset;
 		std::string name;
+		size_t type_id;	// resolved type of the field (@sa Types_t)
 	};
 	typedef std::map<unsigned, fieldname_desc> FieldsNames_t;
-	typedef std::map<int, FieldsNames_t> StructFields_t;
-
-	// BaseType suffix describes intermediate base type modifier such as const or 'pointer'
-	typedef std::map<size_t, std::string> BaseTypeSuffixFile_t;
-	typedef std::map<std::string, BaseTypeSuffixFile_t> BaseTypeSuffix_t;
-	// SrcFiles describe source files described in .debug_info section.
-	typedef std::map<size_t, std::string> SrcFiles_t;
-
-	// @sa ::validate_member
-	enum {
-			VRES_NOT_ARRAY = -1,
-			VRES_NESTED_STRUCTURE = -2,
-			VRES_UNKNOWN = -3,
+	typedef std::unordered_map<uint64_t, FieldsNames_t> StructFields_t; // by type_key
+
+	// Types are base types resolved after parsing: the fully spelled type,
+	// the type at the end of the chain and the first size and count met
+	// in the chain. Types[VOID_TYPE] describes unknown types.
+	struct typeinfo_desc {
+		typeinfo_desc() : top(NO_TYPE), size(0), count(0), flags(0), fields(0) {};
+		std::string spelled;
+		size_t top;		// offset of the type at the end of the chain
+		size_t size;
+		size_t count;
+		unsigned flags;	// varindex::TF_*
+		const FieldsNames_t *fields;	// fields of the top type if any
+	};
+	typedef std::vector<typeinfo_desc> Types_t;
+	enum {VOID_TYPE = 0};
+
+	inline uint64_t hash_chars(const char *s, size_t size) {
+		uint64_t h = 14695981039346656037ull;	// FNV-1a
+		for (size_t i = 0; i < size; ++i) {
+			h ^= (unsigned char)s[i];
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
+
+	inline uint64_t hash_mix(uint64_t h, const uint64_t value) {
+		h ^= value + 0x9e3779b97f4a7c15ull;
+		h *= 0xff51afd7ed558ccdull;
+		return h ^ h >> 33;
+	}
+
+	// Strings interns source files paths and identifiers found in
+	// .debug_info section, so that each of them is stored once and
+	// variables are compared by integer ids instead of strings. The
+	// characters are bump allocated in blocks and never move, ids are
+	// found by an open addressing hash table.
+	class Strings {
+	public:
+		typedef VarInfo::handle_t id_t;
+
+		Strings() : _next(0), _left(0), _hash(16, VarInfo::NO_HANDLE) {};
+
+		id_t intern(const char *s, const size_t size) {
+			const size_t slot = lookup(s, size);
+			if (VarInfo::NO_HANDLE != _hash[slot])
+				return _hash[slot];
+			const id_t id = _strs.size();
+			const string_t str = {store(s, size), size};
+			_strs.push_back(str);
+			_hash[slot] = id;
+			if (2 * _strs.size() > _hash.size())
+				rehash();
+			return id;
+		}
+		id_t intern(const std::string& s) { return intern(s.data(), s.size()); }
+		// Interns a string of another table.
+		id_t intern(const Strings& strings, const id_t id) {
+			const string_t& s = strings._strs[id];
+			return intern(s.chars, s.size);
+		}
+		id_t find(const std::string& s) const {
+			return _hash[lookup(s.data(), s.size())];
+		}
+		std::string str(id_t id) const {
+			if (id >= _strs.size())
+				return std::string();
+			return std::string(_strs[id].chars, _strs[id].size);
+		}
+		size_t size() const { return _strs.size(); }
+		// Memory taken by the table.
+		size_t bytes() const {
+			size_t chars = 0;
+			for (auto b = _blocks.begin(); _blocks.end() != b; ++b)
+				chars += b->second;
+			return chars + _strs.capacity() * sizeof(string_t) +
+				_hash.capacity() * sizeof(id_t);
+		}
+		void swap(Strings& s) {
+			_blocks.swap(s._blocks);
+			std::swap(_next, s._next);
+			std::swap(_left, s._left);
+			_strs.swap(s._strs);
+			_hash.swap(s._hash);
+		}
+	private:
+		struct string_t {
+			const char *chars;
+			size_t size;
 		};
+		// Blocks grow up to this size, tables of small units stay small.
+		enum {MIN_BLOCK = 1024, MAX_BLOCK = 64 * 1024};
+
+		size_t lookup(const char *s, const size_t size) const {
+			const size_t mask = _hash.size() - 1;
+			for (size_t slot = hash_chars(s, size) & mask;; slot = (slot + 1) & mask) {
+				const id_t id = _hash[slot];
+				if (VarInfo::NO_HANDLE == id || (_strs[id].size == size &&
+					0 == memcmp(_strs[id].chars, s, size)))
+					return slot;
+			}
+		}
+		void rehash() {
+			std::vector<id_t> hash(2 * _hash.size(), VarInfo::NO_HANDLE);
+			const size_t mask = hash.size() - 1;
+			for (id_t id = 0; id < _strs.size(); ++id) {
+				size_t slot = hash_chars(_strs[id].chars, _strs[id].size) & mask;
+				while (VarInfo::NO_HANDLE != hash[slot])
+					slot = (slot + 1) & mask;
+				hash[slot] = id;
+			}
+			_hash.swap(hash);
+		}
+		const char *store(const char *s, const size_t size) {
+			if (0 == size)
+				return "";
+			if (size > _left) {
+				const size_t block = std::max<size_t>(size, std::min<size_t>(
+					MAX_BLOCK, MIN_BLOCK << std::min<size_t>(_blocks.size(), 16)));
+				_blocks.push_back(std::make_pair(
+					std::unique_ptr<char[]>(new char[block]), block));
+				_next = _blocks.back().first.get();
+				_left = block;
+			}
+			char *const chars = _next;
+			memcpy(chars, s, size);
+			_next += size;
+			_left -= size;
+			return chars;
+		}
 
-	// Variables describe every variable declared in a program
-	struct Variable {
-		enum {VALUE_NOT_SET = -1};
-		Variable(SrcFiles_t *const srcfiles,
-			BaseTypes_t *const basetypes,
-			BaseTypeSuffix_t *const basetypesuffix) :
-			_srcfiles(srcfiles), _basetypes(basetypes),
-			_basetypesuffix(basetypesuffix),
-			_line(VALUE_NOT_SET), _vis_ended_line(VALUE_NOT_SET),
-			_file_id(VALUE_NOT_SET), _type_offset(VALUE_NOT_SET) {};
-
-		void setLine(size_t line) { _line = line; }
-		void setFile(const std::string& file) {
-			auto it = _srcfiles->end();
-			for (it = _srcfiles->begin(); _srcfiles->end() != it; ++it) {
-				if (file == it->second) {
-					_file_id = it->first;
-					break;
-				}
+		std::vector<std::pair<std::unique_ptr<char[]>, size_t> > _blocks;
+		char		*_next;		// free space of the last block
+		size_t		_left;
+		std::vector<string_t> _strs;	// by id
+		std::vector<id_t> _hash;		// ids by hash of the strings
+	};
+
+	// Fields of a type flattened into a table sorted by offset: fields of
+	// nested structures are laid out in place with paths like "hdr.flags",
+	// an array field is a single entry and its elements are looked up in
+	// the table of the element type (@sa snapshot::field_path).
+	struct field_path_t {
+		uint32_t begin;		// offsets in the type
+		uint32_t end;
+		uint32_t type;		// type id of the field
+		uint32_t field;		// innermost field name (string id)
+		uint32_t path;		// in FieldPaths::text
+		uint32_t path_size;
+		bool	 array;		// elements are to be looked up
+	};
+
+	struct FieldPaths {
+		std::vector<field_path_t> entries;
+		std::string text;
+	};
+
+	// Arrays are laid out as elements, fields behind pointers aren't.
+	inline bool is_array(const varindex::type_t& t) {
+		return 0 != t.count && (!(t.flags & varindex::TF_INDIRECT) ||
+			(t.flags & varindex::TF_POINTERS));
+	}
+
+	// Nested structures are searched no deeper.
+	enum {MAX_NESTING = 32};
+
+	class Variable;
+
+	// Variables declared in a program kept as a structure of arrays: each
+	// attribute of all the variables lies in an array of its own, and the
+	// strings and types tables are referred to once for all of them.
+	class Vars_t {
+	public:
+		Vars_t(Strings *const strings, const Types_t *const types) :
+			_strings(strings), _types(types) {};
+
+		size_t size() const { return _cu.size(); }
+		Variable operator[](size_t i);
+		// Adds a variable of the unit with no attributes set.
+		size_t add(size_t cu) {
+			_cu.push_back(cu);
+			_line.push_back(UINT32_MAX);
+			_vis_end.push_back(UINT32_MAX);
+			_file.push_back(VarInfo::NO_HANDLE);
+			_name.push_back(VarInfo::NO_HANDLE);
+			_type_offset.push_back(UINT32_MAX);
+			_type.push_back(VOID_TYPE);
+			return size() - 1;
+		}
+		void pop_back() {
+			_addresses.erase(size() - 1);
+			_cu.pop_back();
+			_line.pop_back();
+			_vis_end.pop_back();
+			_file.pop_back();
+			_name.pop_back();
+			_type_offset.pop_back();
+			_type.pop_back();
+		}
+		// Adds the variables moving their names to the own strings table.
+		void append(const Vars_t& vars) {
+			std::vector<Strings::id_t> ids(vars._strings->size(), VarInfo::NO_HANDLE);
+			auto rebind = [this, &vars, &ids](Strings::id_t id) {
+				if (VarInfo::NO_HANDLE == id)
+					return id;
+				if (VarInfo::NO_HANDLE == ids[id])
+					ids[id] = _strings->intern(*vars._strings, id);
+				return ids[id];
+			};
+			const size_t first = size();
+			for (size_t i = 0; i < vars.size(); ++i) {
+				_cu.push_back(vars._cu[i]);
+				_line.push_back(vars._line[i]);
+				_vis_end.push_back(vars._vis_end[i]);
+				_file.push_back(rebind(vars._file[i]));
+				_name.push_back(rebind(vars._name[i]));
+				_type_offset.push_back(vars._type_offset[i]);
+				_type.push_back(vars._type[i]);
 			}
-			if (_srcfiles->end() == it) {
-				(*_srcfiles)[_srcfiles->size()] = file;
-				_file_id = _srcfiles->size() - 1;
+			for (auto a = vars._addresses.begin(); vars._addresses.end() != a; ++a)
+				_addresses[first + a->first] = a->second;
+		}
+		// Moves the variables of each unit 'cu' to the unit ids[cu].
+		void renumber_units(const std::vector<size_t>& ids) {
+			for (auto c = _cu.begin(); _cu.end() != c; ++c)
+				*c = ids[*c];
+		}
+		// Keeps only the variables 'keep' is set for, in the same order.
+		void compact(const std::vector<bool>& keep) {
+			std::unordered_map<uint32_t, uint64_t> addresses;
+			size_t n = 0;
+			for (size_t i = 0; i < size(); ++i) {
+				if (!keep[i])
+					continue;
+				_cu[n] = _cu[i];
+				_line[n] = _line[i];
+				_vis_end[n] = _vis_end[i];
+				_file[n] = _file[i];
+				_name[n] = _name[i];
+				_type_offset[n] = _type_offset[i];
+				_type[n] = _type[i];
+				auto a = _addresses.find(i);
+				if (_addresses.end() != a)
+					addresses[n] = a->second;
+				++n;
 			}
+			_cu.resize(n);
+			_line.resize(n);
+			_vis_end.resize(n);
+			_file.resize(n);
+			_name.resize(n);
+			_type_offset.resize(n);
+			_type.resize(n);
+			_addresses.swap(addresses);
 		}
-		inline void setVisEndLine(size_t vis_end_line) {
-			_vis_ended_line = vis_end_line;
-		};
-		inline void setName(const std::string& name) { _name = name; }
-		inline void setTypeOffset(size_t type_offset) {
-			 _type_offset = type_offset;
-		}
-
-		inline size_t line() const { return _line; }
-		inline size_t visEndsLine() const { return _vis_ended_line; }
-		const std::string& file() const {
-			return (*_srcfiles).at(_file_id);
-		}
-		inline const std::string& name() const { return _name; }
-		const std::string type() const {
-			size_t current_offset = _type_offset;
-			static const int max_refs = 256;
-			int i = max_refs;	
-			int next_offset = 0;
-			//printf("TYPING: %d\n", current_offset);
-			std::string suffix;
-			do {
-				std::stringstream ss((*_basetypes)[file()][current_offset].name);
-				ss >> next_offset;
-
-				//printf("TYPING: %d\n", next_offset);
-				if (ss.rdstate() & std::ios::failbit) {
-					if ((*_basetypes)[file()][current_offset].name.empty())
-						return "void" + (suffix.empty() ? "*" : suffix);
-					else
-						return (*_basetypes)[file()][current_offset].name +
-							suffix;
-				}
-				suffix = (*_basetypesuffix)[file()][current_offset] +
-					suffix;
-				current_offset = next_offset;
-			} while(--i > 0);
-			return std::string();
+		void clear() {
+			std::vector<uint32_t>().swap(_cu);
+			std::vector<uint32_t>().swap(_line);
+			std::vector<uint32_t>().swap(_vis_end);
+			std::vector<uint32_t>().swap(_file);
+			std::vector<uint32_t>().swap(_name);
+			std::vector<uint32_t>().swap(_type_offset);
+			std::vector<uint32_t>().swap(_type);
+			std::unordered_map<uint32_t, uint64_t>().swap(_addresses);
 		}
-	
-		int validate_member(const size_t in_str_offset, const size_t type_offset, const size_t nearest_field_offset) const {
-			unsigned tsize = 0, tcount = 0;
-
-			size_t current_offset = type_offset;
-			static const int max_refs = 256;
-			int i = max_refs;	
-			int next_offset = 0;
-			do {
-				const auto& str = (*_basetypes)[file()][current_offset];
-				if (!tcount && str.count)
-					tcount = str.count;
-				if (!tsize && str.size)
-					tsize = str.size;
-					
-				std::stringstream ss(str.name);
-				ss >> next_offset;
-				if (0 == next_offset)
-					break;;
-				current_offset = next_offset;
-			} while(--i > 0);
-			if (0 == tcount) {
-				if (in_str_offset < nearest_field_offset + tsize)
-					return VRES_NESTED_STRUCTURE;
-				else
-					return VRES_UNKNOWN;
-			}
-
-			if ((in_str_offset < tsize * tcount) &&
-				(in_str_offset % tsize == 0))
-				return in_str_offset / tsize;
-			return VRES_NOT_ARRAY;
-		}
-
-		inline size_t type_offset() const { return _type_offset; }
-		// Go to chain of types to get to a main type
-		// `typedef struct { int a, int b; } mytype;`
-		const size_t get_top_offset() const {
-			size_t current_offset = _type_offset;
-			static const int max_refs = 256;
-			int i = max_refs;	
-			int next_offset = 0;
-			do {
-				std::stringstream ss((*_basetypes)[file()][current_offset].name);
-				ss >> next_offset;
-				if (0 == next_offset)
-					return current_offset;
-				current_offset = next_offset;
-			} while(--i > 0);
-			return _type_offset;
-	
+		// Memory taken by the variables, not counting the strings.
+		size_t bytes() const {
+			return 7 * _cu.capacity() * sizeof(uint32_t) +
+				_addresses.size() * (sizeof(uint32_t) + sizeof(uint64_t));
 		}
+
 	private:
-		SrcFiles_t*		_srcfiles;
-		BaseTypes_t*	_basetypes;
-		BaseTypeSuffix_t* _basetypesuffix;
-
-		size_t		_line;			// declaration line (start of the scope for the arguments)
-		size_t		_vis_ended_line;// line where local visibility of the var ends
-		size_t		_file_id;		// declaration file id (@sa SrcFiles_t::first)
-		std::string	_name;			// variable name
-		size_t		_type_offset;	// type description offset (@sa BaseTypes_t::first)
+		friend class Variable;
+		Vars_t(const Vars_t&);
+		Vars_t& operator=(const Vars_t&);
+
+		Strings			*_strings;
+		const Types_t	*_types;
+		std::vector<uint32_t> _cu;			// compilation unit the variable belongs to
+		std::vector<uint32_t> _line;		// declaration line (start of the scope for the arguments)
+		std::vector<uint32_t> _vis_end;		// line where local visibility of the var ends
+		std::vector<uint32_t> _file;		// declaration file id (@sa Strings)
+		std::vector<uint32_t> _name;		// variable name id (@sa Strings)
+		std::vector<uint32_t> _type_offset;	// type description offset (@sa basetype_desc::offset)
+		std::vector<uint32_t> _type;		// resolved type (@sa Types_t)
+		std::unordered_map<uint32_t, uint64_t> _addresses;	// of variables of static storage
 	};
 
-	typedef std::vector<Variable> Vars_t;
-};
-
-
-class VarInfo::Imp {
-public:
-	bool init(const std::string&);
+	// Variable refers to a variable kept in Vars_t. Values that don't fit
+	// 32 bits are kept as not set.
+	class Variable {
+	public:
+		enum {VALUE_NOT_SET = -1};
+		static const uint64_t NO_ADDRESS = ~0ull;
 
-	const std::string fieldname(const std::string &file, const size_t line, const std::string &name,
-		const unsigned offset) const {
+		Variable() : _vars(0), _i(0) {};
+		Variable(Vars_t *const vars, const size_t i) : _vars(vars), _i(i) {};
 
-		const Variable *const var = get_var(file, line, name);
-		if (!var)
-			return "<Unknown>";
-		int hash = hasher(var->file() + std::to_string(var->get_top_offset()));
-		//printf("REQUIRES: off=%d file=%s\n", var->get_top_offset(),
-		//	var->file().c_str());
-		
-		//unsigned __off = _struct_fields[hash][offset].typeoffset;
-		const auto &str = _struct_fields[hash];
-		//for (auto j : str) {
-		//	printf("<%u> %s\n", j.first, j.second.name.c_str());
-		//}
-		auto i = str.rbegin();
-		for (; str.rend() != i; ++i) {
-			if (i->first <= offset) break;
-		}
-		if (str.rend() == i)
-			return "<Unknown>";
-		int idx = var->validate_member(offset, i->second.typeoffset, i->first);
-		if (VRES_NOT_ARRAY == idx) {
-			if (i->first == offset)
-				return i->second.name;
-			else
-				return "<Unknown>";
+		void setLine(size_t line) { _vars->_line[_i] = narrow(line); }
+		void setFile(const std::string& file) {
+			_vars->_file[_i] = _vars->_strings->intern(file);
+		}
+		inline void setVisEndLine(size_t vis_end_line) {
+			_vars->_vis_end[_i] = narrow(vis_end_line);
+		};
+		inline void setName(const std::string& name) {
+			_vars->_name[_i] = _vars->_strings->intern(name);
+		}
+		inline void setTypeOffset(size_t type_offset) {
+			_vars->_type_offset[_i] = narrow(type_offset);
+		}
+		inline void setTypeId(size_t type_id) { _vars->_type[_i] = type_id; }
+		inline void setAddress(uint64_t address) {
+			_vars->_addresses[_i] = address;
 		}
-		else if (VRES_NESTED_STRUCTURE == idx)
-			return i->second.name;
-		else if (VRES_UNKNOWN == idx)
-			return "<Unknown>";
-		return i->second.name + "[" + std::to_string(idx) + "]";
-	}
 
-	const std::string type(const std::string& file,
-		const size_t line,
-		const std::string& name) const {
-		const Variable *const var = get_var(file, line, name);
-		if (!!var)
-			return var->type();
-		return "<Unknown>";
-	}
-private:
-	const Variable *const get_var(const std::string& file,
-		const size_t line, const std::string& name) const {
- 
-		std::map<size_t, Variable*> variants;
-		for (unsigned i = 0; i < _vars.size(); ++i) {
-			Variable *const v = const_cast<Variable *const>(&_vars[i]);
-			if (v->line() <= line && line <= v->visEndsLine() &&
-				 name == v->name() && file == v->file()) {
-				
-				variants[v->line()] = v;
-			}
+		inline size_t line() const { return wide(_vars->_line[_i]); }
+		inline size_t visEndsLine() const { return wide(_vars->_vis_end[_i]); }
+		std::string file() const { return _vars->_strings->str(file_id()); }
+		inline Strings::id_t file_id() const { return _vars->_file[_i]; }
+		std::string name() const { return _vars->_strings->str(name_id()); }
+		inline Strings::id_t name_id() const { return _vars->_name[_i]; }
+		inline size_t cu() const { return _vars->_cu[_i]; }
+		inline size_t type_offset() const { return wide(_vars->_type_offset[_i]); }
+		inline size_t typeinfo_id() const { return _vars->_type[_i]; }
+		inline const typeinfo_desc& typeinfo() const {
+			return (*_vars->_types)[typeinfo_id()];
 		}
-#ifndef __linux
-#pragma warning(suppress : 4172)
-#endif
-		if (0 != variants.size())
-			return variants.rbegin()->second;
-		return 0;
+		const std::string& type() const { return typeinfo().spelled; }
+		inline uint64_t address() const {
+			auto a = _vars->_addresses.find(_i);
+			return _vars->_addresses.end() == a ? NO_ADDRESS : a->second;
+		}
+	private:
+		static uint32_t narrow(size_t value) {
+			return std::min<size_t>(value, UINT32_MAX);
+		}
+		static size_t wide(uint32_t value) {
+			return UINT32_MAX == value ? size_t(VALUE_NOT_SET) : value;
+		}
+
+		Vars_t	*_vars;
+		size_t	_i;
+	};
+
+	inline Variable Vars_t::operator[](size_t i) {
+		return Variable(this, i);
 	}
 
-private:
-	Variable& newVar() {
-		_vars.push_back(Variable(&_src_files, &_base_types,
-			&_base_type_suffix));
-		return _vars[_vars.size() - 1];
+	// The index keeps visibility ranges of all variables sorted by
+	// (file, name, declaration line). Every range refers to the nearest
+	// preceding range of the same (file, name) that covers its declaration
+	// line, so the innermost declaration visible at some line is found by
+	// a binary search followed by a short walk through enclosing scopes.
+	inline bool same_var(const varindex::range_t& l, const varindex::range_t& r) {
+		return l.file == r.file && l.name == r.name;
 	}
 
-	void cancelVar() {
-		_vars.pop_back();
+	// Lines are kept in 32 bits, larger ones (unknown ends of scopes)
+	// are saturated.
+	inline uint32_t index_line(const size_t line) {
+		return std::min<size_t>(line, UINT32_MAX);
 	}
 
-	basetype_desc& newBaseType(const size_t offset, const std::string& file) {
-		return _base_types[file][offset];
+	// Strings of 'next' start with those of 'prev', so the handles given
+	// out by 'prev' are the same strings in 'next'.
+	inline bool same_strings(const varindex& prev, const varindex& next) {
+		if (next.strings_count() < prev.strings_count())
+			return false;
+		for (size_t i = 0; i < prev.strings_count(); ++i) {
+			if (prev.str(i) != next.str(i))
+				return false;
+		}
+		return true;
 	}
 
+	// Adds the time of its scope to 'seconds' if 'on', the clock is not
+	// read otherwise (@sa VarInfo::Options::stats).
+	class phase_timer {
+	public:
+		phase_timer(const bool on, double& seconds) :
+			_seconds(on ? &seconds : 0) {
+			if (!!_seconds)
+				_start = std::chrono::steady_clock::now();
+		}
+		~phase_timer() {
+			if (!!_seconds)
+				*_seconds += std::chrono::duration<double>(
+					std::chrono::steady_clock::now() - _start).count();
+		}
+	private:
+		phase_timer(const phase_timer&);
+		phase_timer& operator=(const phase_timer&);
 
-private:
+		double *const _seconds;
+		std::chrono::steady_clock::time_point _start;
+	};
 
-	Vars_t		_vars;
-	SrcFiles_t	_src_files;
-	BaseTypes_t	_base_types;
+	// Include and exclude globs (@sa fnmatch(3), '*' matches '/' too): a
+	// name passes if it matches some include glob, or there are none, and
+	// no exclude glob.
+	class globs {
+	public:
+		globs() {};
+		globs(const std::vector<std::string>& include,
+			const std::vector<std::string>& exclude) :
+			_include(include), _exclude(exclude) {};
+
+		bool empty() const { return _include.empty() && _exclude.empty(); }
+		bool pass(const char *name) const {
+			return (_include.empty() || match(_include, name)) &&
+				!match(_exclude, name);
+		}
+		// Same for an object of several names, e.g. a type and its
+		// typedefs: one of them is to be included and none excluded.
+		bool pass(const std::vector<const char*>& names) const {
+			bool included = _include.empty();
+			for (auto n = names.begin(); names.end() != n; ++n) {
+				if (match(_exclude, *n))
+					return false;
+				included = included || match(_include, *n);
+			}
+			return included;
+		}
+		// Tells apart data bases built with other globs.
+		std::string key() const {
+			std::string key;
+			for (auto g = _include.begin(); _include.end() != g; ++g)
+				key += '+' + *g + '\n';
+			for (auto g = _exclude.begin(); _exclude.end() != g; ++g)
+				key += '-' + *g + '\n';
+			return key;
+		}
+	private:
+		static bool match(const std::vector<std::string>& globs, const char *name) {
+			for (auto g = globs.begin(); globs.end() != g; ++g)
+				if (0 == fnmatch(g->c_str(), name, 0))
+					return true;
+			return false;
+		}
 
-	BaseTypeSuffix_t _base_type_suffix;
-	mutable StructFields_t _struct_fields;
+		std::vector<std::string> _include;
+		std::vector<std::string> _exclude;
+	};
 
+	// What is indexed (@sa VarInfo::Options::include_files): variables
+	// by their source files and by the names of their types.
+	struct Filters {
+		globs files;
+		globs types;
 
-	scoping		_scoping;
+		bool empty() const { return files.empty() && types.empty(); }
+		std::string key() const {
+			return empty() ? std::string() :
+				"|files:" + files.key() + "|types:" + types.key();
+		}
+	};
 
-	// Required to gather all info about the structure (@sa StructFields_t)
-	struct TypeContainer {
-		bool		_valid;
-		unsigned _type_offset;
-		unsigned _field_type_offset;
-		std::string _fieldname;
-		int			_offset;
-		FieldsNames_t *_fields;
-		basetype_desc *_basetype;
+	// Source files of the units the lazy mode hasn't loaded, mapped by
+	// init() and each reload() and shared by the snapshots published in
+	// between. Queries check the flags without locks, the units of a file
+	// are loaded under the lock (@sa VarInfo::Imp::load_units).
+	struct lazy_files {
+		struct file_t {
+			file_t() : loaded(false) {};
+
+			std::vector<size_t> units;
+			std::atomic<bool> loaded;	// set once a snapshot has the units
+		};
+		std::unordered_map<std::string, file_t> files;
+
+		bool loaded(const std::string& file) const {
+			auto f = files.find(file);
+			return files.end() == f || f->second.loaded.load(std::memory_order_acquire);
+		}
 	};
 
-#ifdef __linux
-private:
-	std::map<Dwarf_Addr, Dwarf_Unsigned> _pcaddr2line;
-	std::string _file;
-	std::string _comp_dir;
+	// What the queries read: the index, the tables of field paths built of
+	// it on demand and the statistics of its construction. A snapshot isn't
+	// changed once published but for the paths added, so queries need no
+	// locks. They keep the snapshot they started with while the next one is
+	// built (@sa VarInfo::Imp::publish).
+	class snapshot {
+	public:
+		snapshot() : generation(0), _npaths(0) {};
+		~snapshot() {
+			for (size_t i = 0; i < _npaths; ++i)
+				delete _paths[i].load();
+		}
 
-	int _die_stack_indent_level;	// nesting level of the current DIEs
-	int _vis_start_line;			// line where the current scope starts
-	int _vis_end_line;				// line where the current scope ends
+		varindex	index;
+		VarInfo::Stats stats;
+		unsigned	generation;	// reloads before it, stamps the results
+		std::shared_ptr<const lazy_files> files;	// the lazy mode only
+
+		// Makes the empty tables of paths, once the index is built.
+		void make_paths() {
+			_npaths = index.fields_count();
+			_paths.reset(_npaths ? new std::atomic<const FieldPaths*>[_npaths] : 0);
+			for (size_t i = 0; i < _npaths; ++i)
+				_paths[i].store(0);
+		}
 
-	void get_attribute(
-		Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Half attr,
-		Dwarf_Attribute attr_in, int die_indent_level,
-		const char *tag_name, char **srcfiles, const std::vector<std::string>& srclist, const char **const cfile,
-		Dwarf_Signed cnt, Dwarf_Off parent_offset,
-		Variable *const var = 0, basetype_desc *const basetype = 0,
-		TypeContainer ** tcon = 0) {
+		// Looks up the ranges of all the declarations of 'name' in 'file'.
+		void get_ranges(const VarInfo::handle_t file, const VarInfo::handle_t name,
+			const varindex::range_t *&first, const varindex::range_t *&last) const {
 
-		const char *v = 0;
-		Dwarf_Error_s *err;
+			first = last = index.ranges_begin();
+			if (VarInfo::NO_HANDLE == file || VarInfo::NO_HANDLE == name)
+				return;
+			varindex::range_t key;
+			key.file = file;
+			key.name = name;
+			key.line = 0;
+			first = std::lower_bound(index.ranges_begin(), index.ranges_end(), key);
+			key.line = UINT32_MAX;
+			last = std::upper_bound(first, index.ranges_end(), key);
+		}
 
-		#define SAY_AND_GO(x)	{ assert(false && x); MY_PRINT(x); }
-		#define SEQ(s) (0== strcmp(v, s))
+		// Looks up the innermost declaration visible at 'line' among the
+		// ranges of a variable (@sa varindex::range_t).
+		const varindex::range_t *const get_var(const varindex::range_t *const first,
+			const varindex::range_t *const end, const size_t line) const {
+
+			if (first == end)
+				return 0;
+			varindex::range_t key = *first;
+			key.line = index_line(line);
+			const varindex::range_t *const last = std::upper_bound(first, end, key);
+			if (first == last)
+				return 0;
+			// Start from the latest declaration preceding the line and follow
+			// the chain of enclosing ranges until the line is inside one.
+			const varindex::range_t *const ranges = index.ranges_begin();
+			const uint32_t lo = first - ranges;
+			uint32_t i = last - ranges - 1;
+			while (uint32_t(varindex::NONE) != i && i >= lo) {
+				const varindex::range_t& r = ranges[i];
+				if (key.line <= r.vis_end)
+					return &r;
+				i = r.enclosing;
+			}
+			return 0;
+		}
 
-		int res = dwarf_get_AT_name(attr, &v);
-		if (DW_DLV_OK != res) {
-			SAY_AND_GO("Failed to get attribute's name\n");
-			return;
+		const varindex::range_t *const get_var(const VarInfo::handle_t file,
+			const size_t line, const VarInfo::handle_t name) const {
+
+			const varindex::range_t *first, *last;
+			get_ranges(file, name, first, last);
+			return get_var(first, last, line);
 		}
 
-		int sres = 0;
-
-		MY_PRINT("%*s%s : ", 2 * die_indent_level, " ", v);
-		const char * form = 0;
-		Dwarf_Half theform = 0;
-		res = dwarf_whatform(attr_in, &theform, &err);
-		if (DW_DLV_OK != res) {
-			SAY_AND_GO("whatform error\n");
-			goto dealloc_attr;
-		}
-		res = dwarf_get_FORM_name(theform, &form);
-		if (DW_DLV_OK != res){
-			SAY_AND_GO("failed to read form information\n");
-			goto dealloc_form;
-		}
-		MY_PRINT("[%s]", form);
-
-		if (SEQ("DW_AT_data_member_location")) {
-			Dwarf_Block *tempb = 0;
-			sres = dwarf_formblock(attr_in, &tempb, &err);
-			if (DW_DLV_OK != sres) { MY_PRINT("failed to read block at attribute"); goto dealloc_form; }
-//			for (unsigned u = 0; u < tempb->bl_len; ++u) {
-//				MY_PRINT("%02x ", *(u + (unsigned char *)tempb->bl_data));
-//			}
-			short offset = 0;
-			short cnt = 0;
-			if (tempb->bl_len >= 3)
-				cnt = *(2 + (unsigned char *)tempb->bl_data);
-			if (tempb->bl_len >= 2)
-				offset = *(1 + (unsigned char *)tempb->bl_data);
-	
-			offset %= 128;
-			offset += cnt * 128;
+		// Fills the result with the type of the variable and its innermost
+		// field at the offset.
+		void resolve(const varindex::range_t *const var, const uint64_t offset,
+			VarInfo::Result& result) const {
+
+			result.type = VarInfo::NO_HANDLE;
+			result.field = VarInfo::NO_HANDLE;
+			result.var_type = varindex::NONE;
+			result.offset = std::min<uint64_t>(offset, UINT32_MAX);
+			result.generation = generation;
+			if (!var)
+				return;
+			result.type = index.type(var->type).spelled;
+			result.var_type = var->type;
+			uint32_t field = varindex::NONE;
+			field_path(var->type, offset, true, 0, field);
+			result.field = field;
+		}
 
-			MY_PRINT("%d", offset);
+		void resolve(const VarInfo::Query *queries, const size_t count,
+			VarInfo::Result *results) const;
 
-			if (!!(*tcon) && (*tcon)->_valid) {
-				(*tcon)->_offset = offset;
-				(*(*tcon)->_fields)[offset].name = (*tcon)->_fieldname;
-				(*(*tcon)->_fields)[offset].typeoffset = (*tcon)->_field_type_offset;
-				MY_PRINT("@FIELD: [%d] off=%d field=%s fieldtype=%d\n",
-					(*tcon)->_type_offset, offset,
-					(*tcon)->_fieldname.c_str(),
-					(*tcon)->_field_type_offset);
-			}
-	
-			dwarf_dealloc(dbg, tempb, DW_DLA_BLOCK);
+		const std::string fieldname(const varindex::range_t *const var,
+			const unsigned offset) const {
 
-		} else if (SEQ("DW_AT_comp_dir")) {
-			char *name = 0;
-			sres = dwarf_formstring(attr_in, &name, &err);
-			if (DW_DLV_OK != sres) { MY_PRINT("failed to read string attribute\n"); goto dealloc_form; }
-			_file = std::string() + name + '/' + _file;
-			*cfile = _file.c_str();	
-			MY_PRINT("\"%s\" ", name);
-			_comp_dir = name;
-			_scoping.init(srclist, _comp_dir + '/');
-			dwarf_dealloc(dbg, name, DW_DLA_STRING); 
-		} else if (SEQ("DW_AT_name")) {
-			char *name = 0;
-			sres = dwarf_formstring(attr_in, &name, &err);
-			if (DW_DLV_OK != sres) { MY_PRINT("failed to read string attribute\n"); goto dealloc_form; }
-			if (0 == die_indent_level)
-				_file = name;
-			MY_PRINT("\"%s\" ", name);
-			if (!!var) {
-				var->setName(name);
-				var->setVisEndLine(_vis_end_line);
-			} else if (!!basetype) {
-				basetype->name = name;
-			}
-			if (!!(*tcon) && (*tcon)->_valid) {
-				(*tcon)->_fieldname = name;
-			}
-			dwarf_dealloc(dbg, name, DW_DLA_STRING);
-		} else if (SEQ("DW_AT_decl_file") || SEQ("DW_AT_call_file")) {
-			Dwarf_Signed val = 0;
-			Dwarf_Unsigned uval = 0;
-			sres = dwarf_formudata(attr_in, &uval, &err);
-			if (DW_DLV_OK != sres) {
-				sres = dwarf_formsdata(attr_in, &val, &err);
-				if (DW_DLV_OK != sres) { SAY_AND_GO("failed to read data attribute\n"); goto dealloc_form; }
-				uval = (Dwarf_Unsigned)val;
-			}
-			*cfile = srcfiles[uval - 1];
-			std::string full_path = *cfile;
-			if ('/' != full_path[0]) {
-				full_path = _comp_dir + '/' + full_path;
-				//printf("%s\n", full_path.c_str());
-			}
-			if (!!var)
-				var->setFile(full_path);
-			if (!!(*tcon) && (0 == strcmp(tag_name, "DW_TAG_structure_type") || 0 == strcmp(tag_name, "DW_TAG_class_type")
-				)
-			) {
-			
-			}
-			MY_PRINT("\"%s\" ", *cfile);
+			std::string path;
+			uint32_t field = varindex::NONE;
+			if (!var || !field_path(var->type, offset, true, &path, field))
+				return "<Unknown>";
+			return path;
 		}
-		else if (SEQ("DW_AT_decl_line")) {
-			Dwarf_Signed val = 0;
-			Dwarf_Unsigned uval = 0;
-			sres = dwarf_formudata(attr_in, &uval, &err);
-			if (DW_DLV_OK != sres) {
-				sres = dwarf_formsdata(attr_in, &val, &err);
-				if (DW_DLV_OK != sres) { SAY_AND_GO("failed to read data attribute\n"); goto dealloc_form; }
-				uval = (Dwarf_Unsigned)val;	
-			}
-			MY_PRINT("\"%lli\" ", uval);
-			if (0 == strcmp(tag_name, "DW_TAG_formal_parameter") && !!var)
-				uval = _scoping.nextScope(var->file(), uval);
+
+		const std::string type(const varindex::range_t *const var) const {
 			if (!!var)
-				var->setLine(uval);
+				return index.str(index.type(var->type).spelled);
+			return "<Unknown>";
 		}
-		else if (SEQ("DW_AT_upper_bound") || SEQ("DW_AT_byte_size")) {
-			Dwarf_Unsigned val = 0;
-			sres = dwarf_formudata(attr_in, &val, &err);
-			if (DW_DLV_OK != sres) { SAY_AND_GO("failed to read data attribute\n"); goto dealloc_form; }
-			MY_PRINT("\"%lli\"", val);
-			if (SEQ("DW_AT_byte_size") && !!basetype) {
-				basetype->size = val;
-			}
-			if (SEQ("DW_AT_upper_bound")) {
-				if (!!tcon && !!*tcon) {
-					(*tcon)->_basetype->count = val;
-				}
+
+		// Appends the path of the field at the offset in an object of the type
+		// to 'path', e.g. "hdr.flags" or "slots[3].key", and gives the innermost
+		// field name. The variable itself ('top') is looked through a pointer
+		// or a reference, its fields aren't. Returns false if no field is there.
+		bool field_path(const uint32_t type, uint64_t offset, const bool top,
+			std::string *const path, uint32_t& field) const {
+
+			const varindex::type_t& t = index.type(type);
+			bool found = false;
+			if (top ? 0 != t.count : is_array(t)) {
+				// The count is the upper bound of the array.
+				const uint64_t stride = std::max<uint64_t>(t.size, 1);
+				const uint64_t element = offset / stride;
+				if (element > t.count)
+					return false;
+				if (!!path)
+					*path += "[" + std::to_string(element) + "]";
+				offset %= stride;
+				found = true;
 			}
-		}
-		else if (SEQ("DW_AT_low_pc") || SEQ("DW_AT_high_pc")) {
-			Dwarf_Addr addr = 0;
-			sres = dwarf_formaddr(attr_in, &addr, &err);
-			if (DW_DLV_OK != sres) {
-				MY_PRINT("failed to read address attribute\n");
-				goto dealloc_form;
+			const bool direct = !(t.flags & varindex::TF_INDIRECT) ||
+				(top && !(t.flags & varindex::TF_POINTERS));
+			if (!direct || 0 == t.nfields)
+				return found;
+
+			const FieldPaths& paths = field_paths(t);
+			auto e = std::upper_bound(paths.entries.begin(), paths.entries.end(),
+				offset, [](uint64_t o, const field_path_t& p) { return o < p.begin; });
+			if (paths.entries.begin() == e || offset >= (--e)->end)
+				return found;
+			if (!!path) {
+				if (!path->empty())
+					*path += '.';
+				path->append(paths.text, e->path, e->path_size);
 			}
-			if (SEQ("DW_AT_low_pc"))
-				_vis_start_line = _pcaddr2line[addr];
-			if (SEQ("DW_AT_high_pc"))	
-				_vis_end_line = _pcaddr2line[addr];
-			MY_PRINT("line:%llu \"0x%08llx\" ",
-				_pcaddr2line[addr], addr);
+			field = e->field;
+			if (e->array)
+				field_path(e->type, offset - e->begin, false, path, field);
+			return true;
 		}
-		else if (SEQ("DW_AT_type")) {
-			Dwarf_Off offset = 0;
-			sres = dwarf_formref(attr_in, &offset, &err);
-			if (DW_DLV_OK != sres) {
-				MY_PRINT("failed to read ref attribute\n");
-				goto dealloc_form;
-			}
-			if (!!var) {
-				var->setTypeOffset(offset);
-			}
-			else if (!!basetype) {
-				std::stringstream ss;
-				ss << offset;
-				basetype->name = ss.str();
-				if (0 == strcmp(tag_name, "DW_TAG_pointer_type"))
-					_base_type_suffix[_file][parent_offset] = "*";
-				else if (0 == strcmp(tag_name, "DW_TAG_const_type"))
-					_base_type_suffix[_file][parent_offset] = " const";
-				else if (0 == strcmp(tag_name, "DW_TAG_reference_type"))
-					_base_type_suffix[_file][parent_offset] = "&";
-				else if (0 == strcmp(tag_name, "DW_TAG_volatile_type"))
-					_base_type_suffix[_file][parent_offset] = " volatile";
-			}
 
-			if (!!(*tcon) && (*tcon)->_valid) {
-				(*tcon)->_field_type_offset = offset;
-			}	
-			MY_PRINT("<0x%08llu> ", offset);
+		bool symbolize(const uint64_t address, VarInfo::Symbol& symbol) const {
+			// The last variable starting at or before the address.
+			const varindex::symbol_t *const begin = index.symbols_begin();
+			const varindex::symbol_t *s = std::upper_bound(begin,
+				index.symbols_end(), address,
+				[](uint64_t a, const varindex::symbol_t& sym) { return a < sym.address; });
+			if (begin == s || address - (s - 1)->address >= (s - 1)->size)
+				return false;
+			--s;
+			const varindex::range_t *const var = index.ranges_begin() + s->range;
+			if (var >= index.ranges_end())
+				return false;
+			symbol.file = var->file;
+			symbol.line = var->line;
+			symbol.name = var->name;
+			symbol.offset = address - s->address;
+			resolve(var, symbol.offset, symbol.result);
+			return true;
 		}
-		MY_PRINT("\n");
-dealloc_form:
-		//dwarf_dealloc(dbg, (char *)form, DW_DLA_STRING);
-dealloc_attr:;
-		//dwarf_dealloc(dbg, (void *)v, DW_DLA_STRING);
-	}
 
-	bool print_one_die(Dwarf_Debug dbg, Dwarf_Die die,
-		int die_indent_level, char **srcfiles,
-		const char* *const cfile, Dwarf_Signed cnt, const std::vector<std::string>& srclist, TypeContainer ** tcon = 0) {
+	private:
+		snapshot(const snapshot&);
+		snapshot& operator=(const snapshot&);
 
-		Dwarf_Error_s *err;
-		Dwarf_Half tag = 0;
+		const FieldPaths& field_paths(const varindex::type_t& t) const;
+		void flatten(const varindex::type_t& t, const uint32_t base,
+			const std::string& prefix, FieldPaths& paths, const int depth) const;
 
-		int tres = dwarf_tag(die, &tag, &err);
-		if (DW_DLV_OK != tres) {
-			MY_PRINT("Failed to obtain the tag\n");
-			return false;
-		}
+		// Tables of fields paths built on demand, by the first field of a
+		// type (@sa FieldPaths).
+		mutable std::unique_ptr<std::atomic<const FieldPaths*>[]> _paths;
+		size_t		_npaths;
+	};
+};
 
-		const char * tagname = 0;
-		Dwarf_Signed atcnt = 0;
-		Dwarf_Attribute *atlist = 0;
-		int atres = 0;
-		Variable *var = 0;
-		basetype_desc *basetype = 0;
-		Dwarf_Off offset = 0;	
-	
-		int res = dwarf_get_TAG_name(tag, &tagname);
-		if (DW_DLV_OK != res) {
-			MY_PRINT("Failed to get the name of the tag\n");
-			goto dealloc_tag_name;
-		}
-		#define SEQ1(s)	(0 == strcmp(s, tagname))
-		if (
-			!SEQ1("DW_TAG_compile_unit")
-			&& !SEQ1("DW_TAG_base_type")
-			&& !SEQ1("DW_TAG_formal_parameter")
-			&& !SEQ1("DW_TAG_lexical_block")
-			&& !SEQ1("DW_TAG_variable")
-			&& !SEQ1("DW_TAG_subprogram")
-			&& !SEQ1("DW_TAG_pointer_type")
-			&& !SEQ1("DW_TAG_const_type")
-			&& !SEQ1("DW_TAG_reference_type")
-			&& !SEQ1("DW_TAG_volatile_type")
-			&& !SEQ1("DW_TAG_typedef")
-			&& !SEQ1("DW_TAG_structure_type")
-			&& !SEQ1("DW_TAG_class_type")
-			&& !SEQ1("DW_TAG_member")
-			&& !SEQ1("DW_TAG_array_type")
-			&& !SEQ1("DW_TAG_subrange_type")
-			)
-			goto dealloc_tag_name;
-
-		if (SEQ1("DW_TAG_subprogram"))
-			_vis_end_line = 0;
 
-		MY_PRINT("\n%*s[%d]%s ", 2 * die_indent_level, " ", die_indent_level, tagname);
-		res = dwarf_die_CU_offset(die, &offset, &err);
-		if (DW_DLV_OK != res) {
-			MY_PRINT("Failed to get die CU offset\n");
-			goto dealloc_tag_name;
-		}
-
-		if (0 == strcmp(tagname, "DW_TAG_variable") ||
-			0 == strcmp(tagname, "DW_TAG_formal_parameter")) {
-			var = &newVar();
-		} else if (0 == strcmp(tagname, "DW_TAG_base_type") ||
-			0 == strcmp(tagname, "DW_TAG_pointer_type") ||
-			0 == strcmp(tagname, "DW_TAG_const_type") ||
-			0 == strcmp(tagname, "DW_TAG_reference_type") ||
-			0 == strcmp(tagname, "DW_TAG_volatile_type") ||
-			0 == strcmp(tagname, "DW_TAG_typedef") ||
-			0 == strcmp(tagname, "DW_TAG_structure_type") ||
-			0 == strcmp(tagname, "DW_TAG_class_type") ||
-			0 == strcmp(tagname, "DW_TAG_array_type")) {
-			basetype = &newBaseType(offset, _file);
-			//printf("%s ", tagname);
-			//printf("=TYPES: off=%d file=%s\n", offset, _file.c_str());
-		}
+class VarInfo::Imp {
+public:
+	Imp() : _snapshot(std::make_shared<snapshot>()), _generation(0),
+		_vars(&_strings, &_types), _lazy(false), _native(false),
+		_incremental(false), _timed(false) {};
 
-		if (die_indent_level <= 1 && 
-			(0 == strcmp(tagname, "DW_TAG_structure_type") ||
-			0 == strcmp(tagname, "DW_TAG_class_type") ||
-			0 == strcmp(tagname, "DW_TAG_array_type"))) {
-			delete (*tcon);
-			*tcon = new TypeContainer;
-			(*tcon)->_type_offset = offset;
-			(*tcon)->_fields = &_struct_fields[hasher(_file + std::to_string((*tcon)->_type_offset))];
-			(*tcon)->_basetype = basetype;
-				//printf("=FIELDS: off=%d file=%s\n", (*tcon)->_type_offset, _file.c_str());
+	bool init(const std::string&, const VarInfo::Options&);
+	bool reload(const std::string&);
 
-		}
-		
-		if (!!(*tcon)) {
-			if (0 == strcmp(tagname, "DW_TAG_member"))
-				(*tcon)->_valid = true;
-			else
-				(*tcon)->_valid = false;
-		}
-		MY_PRINT("<0x%08llu>\r\n", offset);
+	VarInfo::handle_t file_handle(const std::string& file) const {
+		return current(file)->index.find(file);
+	}
 
-		atres = dwarf_attrlist(die, &atlist, &atcnt, &err);
-		if (DW_DLV_ERROR == atres)
-			MY_PRINT("Error while getting the attributes\n");
-		else if (DW_DLV_NO_ENTRY == atres)
-			atcnt = 0;
-
-		for (Dwarf_Signed i = 0; i < atcnt; ++i) {
-			Dwarf_Half attr;
-			int ares = dwarf_whatattr(atlist[i], &attr, &err);
-			if (DW_DLV_OK != ares) {
-				MY_PRINT("<Cannot get attributes>\n");
-				continue;
-			}
-			MY_PRINT("%*s", 2 * die_indent_level + 1, " ");
-			get_attribute(dbg, die, attr, atlist[i],
-				die_indent_level, tagname,
-				srcfiles, srclist, cfile, cnt, offset, var, basetype, tcon);
-		}
-		for (Dwarf_Signed i = 0; i < atcnt; ++i)
-			dwarf_dealloc(dbg, atlist[i], DW_DLA_ATTR);
-		if (DW_DLV_OK == atres)
-			dwarf_dealloc(dbg, atlist, DW_DLA_LIST);
+	// Names can't be known before all units are loaded, so the lazy mode
+	// gives out handles to any name, the ones not indexed yet are interned
+	// under the lock.
+	VarInfo::handle_t name_handle(const std::string& name) const {
+		const VarInfo::handle_t handle = current()->index.find(name);
+		if (!_lazy || VarInfo::NO_HANDLE != handle)
+			return handle;
+		auto lock = lock_lazy();
+		return const_cast<Strings&>(_strings).intern(name);
+	}
 
-		if (!!var) {
-			if (size_t(Variable::VALUE_NOT_SET) == var->line() ||
-				var->name().empty()) {
-				cancelVar();
-				return true;
-			}
-			// Fix the end line of the scope as debugging info
-			// often gives incorrect values.
-			std::pair<int, int> ranges = _scoping.scope(var->file(),
-				var->line());
-			var->setVisEndLine(ranges.second);
-			MY_PRINT("@VARIABLE: [%lu] \"%s\" %lu-%lu (%s)\n",
-				var->type_offset(),
-				var->name().c_str(),
-				var->line(), var->visEndsLine(),
-				var->file().c_str());
+	const std::string fieldname(const std::string &file, const size_t line, const std::string &name,
+		const unsigned offset) const {
+		const std::shared_ptr<const snapshot> s = current(file);
+		return s->fieldname(s->get_var(s->index.find(file), line,
+			s->index.find(name)), offset);
+	}
+
+	const std::string fieldname(const VarInfo::handle_t file, const size_t line,
+		const VarInfo::handle_t name, const unsigned offset) const {
+		const std::shared_ptr<const snapshot> s = current(file);
+		return s->fieldname(s->get_var(file, line, name), offset);
+	}
+
+	const std::string type(const std::string& file,
+		const size_t line,
+		const std::string& name) const {
+		const std::shared_ptr<const snapshot> s = current(file);
+		return s->type(s->get_var(s->index.find(file), line, s->index.find(name)));
+	}
+
+	const std::string type(const VarInfo::handle_t file,
+		const size_t line,
+		const VarInfo::handle_t name) const {
+		const std::shared_ptr<const snapshot> s = current(file);
+		return s->type(s->get_var(file, line, name));
+	}
+
+	void resolve(const VarInfo::Query *queries, const size_t count,
+		VarInfo::Result *results, unsigned threads) const;
+
+	// The index of the lazy mode has the strings of the strings table
+	// when it was built, with the same ids. Names given out since are
+	// looked up in the table under the lock.
+	const std::string text(const VarInfo::handle_t handle) const {
+		const std::shared_ptr<const snapshot> s = current();
+		if (!_lazy || handle < s->index.strings_count() ||
+			VarInfo::NO_HANDLE == handle)
+			return s->index.str(handle);
+		auto lock = lock_lazy();
+		return handle < _strings.size() ? _strings.str(handle) : std::string();
+	}
+
+	// Types of a result of an earlier reload are of another index, the
+	// units loaded since in the lazy mode only add types.
+	const std::string result_fieldname(const VarInfo::Result& result) const {
+		const std::shared_ptr<const snapshot> s = current();
+		std::string path;
+		uint32_t field = varindex::NONE;
+		if (result.generation != s->generation ||
+			result.var_type >= s->index.types_count() ||
+			!s->field_path(result.var_type, result.offset, true, &path, field))
+			return "<Unknown>";
+		return path;
+	}
+
+	VarInfo::Stats stats() const {
+		return current()->stats;
+	}
+
+	bool symbolize(const uint64_t address, VarInfo::Symbol& symbol) const {
+		return current()->symbolize(address, symbol);
+	}
+
+private:
+	// The snapshot queries start with, init() and reload() replace it
+	// while queries keep going on the previous one (@sa publish).
+	std::shared_ptr<const snapshot> current() const {
+		return std::atomic_load(&_snapshot);
+	}
+
+	// The snapshot with the units of the file, the lazy mode loads them
+	// first. Loading doesn't change results of queries, only makes them
+	// available.
+	std::shared_ptr<const snapshot> current(const std::string& file) const {
+		const std::shared_ptr<const snapshot> s = current();
+		if (!s->files)
+			return s;
+		if (s->files->loaded(file)) {
+			// Units loaded before the check are in the snapshots published
+			// after it, unless a reload has mapped the files anew since.
+			const std::shared_ptr<const snapshot> next = current();
+			if (next->files == s->files)
+				return next;
 		}
-		else if (!!basetype) {
-			MY_PRINT("@BASETYPE: %llu[%s] -> %s \"%s\", size=%lu, count=%lu (%s)\n", offset,
-				tagname, basetype->name.c_str(),
-				_base_type_suffix[_file][offset].c_str(), basetype->size, basetype->count, _file.c_str());
+		auto lock = lock_lazy();
+#ifdef __linux
+		const_cast<Imp *>(this)->load_units(file);
+#endif // __linux
+		return current();
+	}
+	std::shared_ptr<const snapshot> current(const VarInfo::handle_t file) const {
+		if (!_lazy || VarInfo::NO_HANDLE == file)
+			return current();
+		return current(text(file));
+	}
+
+	void publish(const std::shared_ptr<snapshot>& next);
+
+	// Queries only read a snapshot, so they need no locks. Queries of the
+	// lazy mode which load units and rebuild the index go one by one, and
+	// so does reload() with them.
+	std::unique_lock<std::mutex> lock_lazy() const {
+		return _lazy ? std::unique_lock<std::mutex>(_mutex) :
+			std::unique_lock<std::mutex>();
+	}
+
+	void resolve_types(const size_t first_cu, const size_t first_var);
+	void drop_units(const std::vector<bool>& dead);
+	std::shared_ptr<snapshot> build_index(const std::string& key);
+	void count_tables();
+
+private:
+	const basetype_desc *locate_type(size_t& cu, size_t offset) const;
+	size_t type_id(const size_t cu, const size_t offset) const;
+	void type_names(size_t cu, size_t offset, std::vector<const char*>& names) const;
+	void filter_vars(const size_t first_var);
+	size_t resolve_type(const size_t cu, const size_t offset);
+	void unify_types(const size_t first_type, const size_t first_cu);
+
+
+private:
+
+	// All the queries are answered by, accessed with the atomic
+	// operations of shared_ptr only.
+	std::shared_ptr<const snapshot> _snapshot;
+	unsigned	_generation;	// reloads done (@sa snapshot::generation)
+
+	// Parsing results, the index is built of them.
+	Vars_t		_vars;
+	Strings		_strings;
+	BaseTypes_t	_base_types;	// kept until resolved, but of type units
+	Types_t		_types;
+	std::vector<std::vector<uint64_t> > _cu_signatures;	// by CU id (@sa SIGNATURE_REF)
+	std::vector<bool> _cu_type_units;	// by CU id
+	std::unordered_map<uint64_t, uint64_t> _signature_types;	// type_key by signature
+	std::vector<std::string> _cu_files;	// CU file names by CU id
+	std::vector<size_t> _cu_units;		// unit numbers by CU id
+	std::vector<uint64_t> _cu_fingerprints;	// by CU id, 0 - unknown or dropped
+	std::vector<std::vector<uint64_t> > _cu_statics;	// by CU id, with the fingerprints
+	std::unordered_map<uint64_t, uint64_t> _object_sizes;	// by address (@sa object_sizes)
+
+	StructFields_t _struct_fields;
+
+	Filters		_filters;	// @sa VarInfo::Options::include_files
+	bool		_lazy;		// @sa VarInfo::Options::lazy
+	bool		_native;	// @sa VarInfo::Options::native
+	bool		_incremental;	// @sa VarInfo::Options::incremental, or lazy
+	mutable std::mutex _mutex;	// @sa lock_lazy
+	std::mutex	_reload_mutex;	// one reload() at a time
+
+	bool		_timed;		// @sa VarInfo::Options::stats
+	VarInfo::Stats _stats;	// scopes are counted by _scopes
+
+#ifdef __linux
+private:
+	class CU;
+	class DwarfFile;
+	class Inflated;
+	struct Binary;
+
+	std::string _path;		// file with DWARF of the binary (@sa debug_file)
+	std::string _debug_dir;	// @sa VarInfo::Options::debug_dir
+	std::string _cache_dir;	// @sa VarInfo::Options::cache_dir
+	unsigned	_threads;	// @sa VarInfo::Options::threads
+	scoping::cache _scopes;	// scopes of the sources of all units
+	std::unique_ptr<Inflated> _inflated;	// compressed sections of _path
+	TypeUnits_t _type_units;	// listed by libdwarf (@sa list_units)
+
+	// The lazy mode state.
+	std::unique_ptr<DwarfFile> _dwarf;	// kept open to load units
+	std::vector<Dwarf_Off> _units;		// all units
+	std::vector<bool> _loaded;			// by unit
+	std::shared_ptr<lazy_files> _files;	// of the units not loaded
+
+	template<class Job>
+	void for_each_unit(Dwarf_Debug dbg, const std::string& path,
+		Inflated& inflated, double& open, const std::vector<Dwarf_Off>& units,
+		Job job);
+	template<class Job>
+	void for_each_unit(Dwarf_Debug dbg, const std::vector<Dwarf_Off>& units,
+		Job job) {
+		for_each_unit(dbg, _path, *_inflated, _stats.open, units, job);
+	}
+	template<class Job>
+	void for_each_unit(const dwarfreader& reader,
+		const std::vector<Dwarf_Off>& units, Job job);
+	void merge_cu(CU& cu);
+	void parse_units(Dwarf_Debug dbg, const dwarfreader *reader,
+		const dwarfreader *prints, const std::vector<Dwarf_Off>& units,
+		const std::vector<size_t>& numbers);
+	bool scan_units();
+	void list_files(const DwarfFile& dwarf, const std::string& path,
+		Inflated& inflated, double& open, const std::vector<Dwarf_Off>& units,
+		std::vector<std::vector<std::string> >& files);
+	void map_units(const std::vector<std::vector<std::string> >& files);
+	void load_units(const std::string& file);
+	bool build(const std::string& file, const bool lazy, std::shared_ptr<snapshot>& next);
+	bool read_binary(const std::string& file, Binary& binary);
+	void rebuild(Binary& binary, std::shared_ptr<snapshot>& next);
+	std::string cache_file(const std::string& file, std::string& key) const;
+	int collect_vars_info(Elf * elf);
+	int parse_debug_info(int fd);
+	bool read_file_debug(const char * file);
+#endif // __linux
+};
+
+
+#ifdef __linux
+namespace {
+	// ELF files are opened read only and mapped, not read: debug files
+	// are large and only a part of them is used.
+	Elf *open_elf(const std::string& path, int& fd) {
+		fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return 0;
+		elf_version(EV_CURRENT);
+		Elf *const elf = elf_begin(fd, ELF_C_READ_MMAP, NULL);
+		if (!elf) {
+			close(fd);
+			fd = -1;
 		}
-		//dwarf_dealloc(dbg, (void *)tagname, DW_DLA_STRING);
-		return true;
-dealloc_tag_name:
-		//dwarf_dealloc(dbg, (void *)tagname, DW_DLA_STRING);
-		return false;
+		return elf;
 	}
 
-	void print_die_and_children(Dwarf_Debug dbg,
-		Dwarf_Die in_die_in, Dwarf_Bool is_info, char **srcfiles,
-		const char **const cfile, Dwarf_Signed cnt, const std::vector<std::string>& srclist, TypeContainer **tcon = 0) {
+	void close_elf(Elf *elf, int fd) {
+		if (!!elf)
+			elf_end(elf);
+		if (fd >= 0)
+			close(fd);
+	}
 
-		Dwarf_Die in_die = in_die_in;
-		Dwarf_Error_s *err;
-		Dwarf_Die child = 0;
-		Dwarf_Die sibling = 0;
+	// Returns the section of the name or 0.
+	Elf_Scn *find_section(Elf *elf, const char *name) {
+		size_t shstrndx = 0;
+		if (0 != elf_getshdrstrndx(elf, &shstrndx))
+			return 0;
+		for (Elf_Scn *scn = 0; !!(scn = elf_nextscn(elf, scn));) {
+			GElf_Shdr shdr;
+			const char *s = !gelf_getshdr(scn, &shdr) ? 0 :
+				elf_strptr(elf, shstrndx, shdr.sh_name);
+			if (!!s && 0 == strcmp(s, name))
+				return scn;
+		}
+		return 0;
+	}
 
-		int cdres = 0;
+	// Whether the file is of the byte order of the host.
+	bool host_byte_order(Elf *elf) {
+		const char *const ident = elf_getident(elf, NULL);
+		const uint16_t one = 1;
+		const unsigned char host = 1 == *(const char *)&one ? ELFDATA2LSB : ELFDATA2MSB;
+		return !!ident && host == (unsigned char)ident[EI_DATA];
+	}
 
-		for (;;) {
-			if (print_one_die(dbg, in_die, _die_stack_indent_level,
-				srcfiles, cfile, cnt, srclist, tcon)) {
-				
-				cdres = dwarf_child(in_die, &child, &err);
-	
-				if (DW_DLV_OK == cdres) {
-					++_die_stack_indent_level;
-					print_die_and_children(dbg, child, is_info,
-						srcfiles, cfile, cnt, srclist, tcon);
-					--_die_stack_indent_level;
-					dwarf_dealloc(dbg, child, DW_DLA_DIE);
-					child = 0;
-				}
-				else if (DW_DLV_ERROR == cdres) {
-					MY_PRINT("Error while obtaining a child\n");
-					return;
-				}
-			}
-		
-			cdres = dwarf_siblingof_b(dbg, in_die, is_info, &sibling, &err);
-			if (DW_DLV_ERROR == cdres) {
-				MY_PRINT("Failed to get a sibling\n");
-				return;
-			}
+	// Sections of the built-in reader (@sa dwarfreader), right from the
+	// mapped file or inflated (@sa VarInfo::Imp::Inflated). Returns false
+	// if it can't read them: big endian, still compressed or no DWARF.
+	bool native_sections(Elf *elf, dwarfreader::section_t *sections) {
+		const uint16_t one = 1;
+		if (1 != *(const char *)&one || !host_byte_order(elf))
+			return false;
+		for (int s = 0; s < dwarfreader::SECTIONS; ++s) {
+			sections[s].data = 0;
+			sections[s].size = 0;
+			Elf_Scn *const scn = find_section(elf, dwarfreader::section_names[s]);
+			GElf_Shdr shdr;
+			if (!scn || !gelf_getshdr(scn, &shdr) || SHT_NOBITS == shdr.sh_type)
+				continue;
+			if (shdr.sh_flags & SHF_COMPRESSED)
+				return false;
+			Elf_Data *const data = elf_getdata(scn, 0);
+			if (!data || !data->d_buf)
+				continue;
+			sections[s].data = (const unsigned char *)data->d_buf;
+			sections[s].size = data->d_size;
+		}
+		return !!sections[dwarfreader::INFO].data;
+	}
 
-			if (in_die != in_die_in) {
-				dwarf_dealloc(dbg, in_die, DW_DLA_DIE);
-				in_die = 0;
+	// Returns the bytes of the GNU build id note, empty if there is none.
+	std::string build_id(Elf *elf) {
+		std::string id;
+		for (Elf_Scn *scn = 0; id.empty() && !!(scn = elf_nextscn(elf, scn));) {
+			GElf_Shdr shdr;
+			if (!gelf_getshdr(scn, &shdr) || SHT_NOTE != shdr.sh_type)
+				continue;
+			Elf_Data *const data = elf_getdata(scn, 0);
+			if (!data)
+				continue;
+			GElf_Nhdr note;
+			size_t name_at = 0, desc_at = 0;
+			for (size_t next = 0; id.empty() && 0 != (next = gelf_getnote(
+				data, next, &note, &name_at, &desc_at));) {
+				const char *const notes = (const char *)data->d_buf;
+				if (NT_GNU_BUILD_ID == note.n_type && 4 == note.n_namesz &&
+					0 == memcmp(notes + name_at, "GNU", 4))
+					id.assign(notes + desc_at, note.n_descsz);
 			}
-			if (DW_DLV_OK == cdres)
-				in_die = sibling;
-			else
-				break;
 		}
+		return id;
 	}
 
-	
-	void print_line_numbers_info(Dwarf_Debug dbg, Dwarf_Die cu_die) {
-
-		Dwarf_Error_s *err;
-		Dwarf_Line *linebuf = NULL;
-		Dwarf_Signed linecount = 0;
+	std::string build_id(const std::string& path) {
+		int fd;
+		Elf *const elf = open_elf(path, fd);
+		const std::string id = !elf ? std::string() : build_id(elf);
+		close_elf(elf, fd);
+		return id;
+	}
 
-		int lres = dwarf_srclines(cu_die, &linebuf,
-			&linecount, &err);
-		switch(lres) {
-		case DW_DLV_ERROR:
-			MY_PRINT("Error in reading line numbers information\n");
-			return;
-		case DW_DLV_NO_ENTRY:
-			MY_PRINT("No line numbers information\n");
-			return;
-		default:;
+	// CRC of .gnu_debuglink, zlib's CRC-32 of the whole file.
+	bool file_crc(const std::string& path, uint32_t& crc) {
+		const int fd = open(path.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd < 0 || 0 != fstat(fd, &st)) {
+			if (fd >= 0)
+				close(fd);
+			return false;
+		}
+		crc = crc32(0, Z_NULL, 0);
+		void *const p = 0 == st.st_size ? MAP_FAILED :
+			mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (MAP_FAILED == p)
+			return 0 == st.st_size;
+		// crc32() takes 32 bit lengths.
+		for (off_t done = 0; done < st.st_size;) {
+			const uInt n = std::min<off_t>(st.st_size - done, 1 << 30);
+			crc = crc32(crc, (const Bytef *)p + done, n);
+			done += n;
 		}
+		munmap(p, st.st_size);
+		return true;
+	}
 
-		int ares = 0, sres = 0;
-		Dwarf_Addr pc = 0;
-		Dwarf_Unsigned lineno = 0;
-		char * filename = 0;
-		for (Dwarf_Signed i = 0; i < linecount; ++i) {
-			Dwarf_Line line = linebuf[i];
-			filename = (char *)"<unknown>";
-			sres = dwarf_linesrc(line, &filename, &err);
-			if (DW_DLV_ERROR == sres) {
-				MY_PRINT("cannot read a source file that corresponds " 
-					"to the line\n");
-			} else {
-				ares = dwarf_lineaddr(line, &pc, &err);
+	bool is_file(const std::string& path) {
+		struct stat st;
+		return 0 == stat(path.c_str(), &st) && S_ISREG(st.st_mode);
+	}
+
+	// Finds the file with DWARF of the binary: the binary itself if it has
+	// .debug_info, or the separate debug file found by its build id under
+	// 'debug_dir' or by its .gnu_debuglink, the way gdb finds them. A debug
+	// file must have the build id of the binary, if the binary has one.
+	std::string debug_file(const std::string& path, const std::string& debug_dir) {
+		int fd;
+		Elf *const elf = open_elf(path, fd);
+		if (!elf || !!find_section(elf, ".debug_info")) {
+			close_elf(elf, fd);
+			return path;
+		}
+		const std::string id = build_id(elf);
+		std::vector<std::string> candidates;
+		if (!id.empty() && !debug_dir.empty()) {
+			static const char digits[] = "0123456789abcdef";
+			std::string hex;
+			for (size_t i = 0; i < id.size(); ++i) {
+				hex += digits[(unsigned char)id[i] >> 4];
+				hex += digits[(unsigned char)id[i] & 0xf];
 			}
-			if (DW_DLV_ERROR == ares) {
-				MY_PRINT("failed to obtain source - pc association\n");
+			candidates.push_back(debug_dir + "/.build-id/" + hex.substr(0, 2) +
+				'/' + hex.substr(2) + ".debug");
+		}
+		// The section is the file name, padding to 4 bytes and the CRC.
+		std::string link;
+		uint32_t crc = 0;
+		Elf_Scn *const scn = find_section(elf, ".gnu_debuglink");
+		Elf_Data *const data = !scn ? 0 : elf_getdata(scn, 0);
+		if (!!data && data->d_size >= 8) {
+			const char *const s = (const char *)data->d_buf;
+			link.assign(s, strnlen(s, data->d_size));
+			const size_t at = (link.size() + 4) & ~size_t(3);
+			if (at + 4 <= data->d_size)
+				memcpy(&crc, s + at, 4);
+			else
+				link.clear();
+		}
+		close_elf(elf, fd);
+		const size_t slash = path.rfind('/');
+		const std::string dir = std::string::npos == slash ? "." : path.substr(0, slash);
+		const size_t first_link = candidates.size();
+		if (!link.empty()) {
+			candidates.push_back(dir + '/' + link);
+			candidates.push_back(dir + "/.debug/" + link);
+			if (!debug_dir.empty())
+				candidates.push_back(debug_dir + '/' + dir + '/' + link);
+		}
+
+		for (size_t i = 0; i < candidates.size(); ++i) {
+			const std::string& c = candidates[i];
+			uint32_t c_crc = 0;
+			if (c == path || !is_file(c) || (!id.empty() && build_id(c) != id) ||
+				(i >= first_link && (!file_crc(c, c_crc) || c_crc != crc)))
 				continue;
-			}
-			ares = dwarf_lineno(line, &lineno, &err);
-			
-			if (DW_DLV_ERROR == ares) {
-				MY_PRINT("failed to get a line number for the pc addr\n");
+			MY_PRINT("Debug file of %s: %s\n", path.c_str(), c.c_str());
+			return c;
+		}
+		return path;
+	}
+
+	// Identifies the binary for the index cache: by its build id if it
+	// has one, by its path, size and modification time otherwise.
+	std::string binary_key(const std::string& path) {
+		std::string key;
+		const std::string id = build_id(path);
+		if (!id.empty())
+			key = "build-id:" + id;
+		const int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return key;
+		struct stat st;
+		if (key.empty() && 0 == fstat(fd, &st)) {
+			key = "file:" + path + ':' + std::to_string(st.st_size) + ':' +
+				std::to_string(st.st_mtim.tv_sec) + '.' +
+				std::to_string(st.st_mtim.tv_nsec);
+		}
+		close(fd);
+		return key;
+	}
+
+	// Reads sizes of data objects of the symbol table by their addresses.
+	void object_sizes(const std::string& path,
+		std::unordered_map<uint64_t, uint64_t>& sizes) {
+		int fd;
+		Elf *const elf = open_elf(path, fd);
+		for (Elf_Scn *scn = 0; !!elf && !!(scn = elf_nextscn(elf, scn));) {
+			GElf_Shdr shdr;
+			if (!gelf_getshdr(scn, &shdr) || SHT_SYMTAB != shdr.sh_type ||
+				0 == shdr.sh_entsize)
 				continue;
-			}
-			if (DW_DLV_NO_ENTRY == ares)
+			Elf_Data *const data = elf_getdata(scn, 0);
+			if (!data)
 				continue;
-			
-			_pcaddr2line[pc] = lineno;
+			const size_t count = shdr.sh_size / shdr.sh_entsize;
+			for (size_t i = 0; i < count; ++i) {
+				GElf_Sym sym;
+				if (!!gelf_getsym(data, i, &sym) &&
+					STT_OBJECT == GELF_ST_TYPE(sym.st_info) && 0 != sym.st_size)
+					sizes[sym.st_value] = sym.st_size;
+			}
+		}
+		if (!!elf)
+			elf_end(elf);
+		close(fd);
+	}
 
-			if (DW_DLV_OK == sres)
-				dwarf_dealloc(dbg, filename, DW_DLA_STRING);
+	enum {TAG_SKIPPED = -2, TAG_NOT_TYPE = -1};
+
+	// Returns the kind of the type declared by DIEs with the tag,
+	// TAG_NOT_TYPE for other DIEs to be read and TAG_SKIPPED for DIEs
+	// which are skipped with their children.
+	int tag_kind(Dwarf_Half tag) {
+		switch (tag) {
+		case DW_TAG_base_type:		return TK_BASE;
+		case DW_TAG_pointer_type:	return TK_POINTER;
+		case DW_TAG_const_type:		return TK_CONST;
+		case DW_TAG_reference_type:	return TK_REFERENCE;
+		case DW_TAG_volatile_type:	return TK_VOLATILE;
+		case DW_TAG_typedef:		return TK_TYPEDEF;
+		case DW_TAG_structure_type:	return TK_STRUCTURE;
+		case DW_TAG_class_type:		return TK_CLASS;
+		case DW_TAG_array_type:		return TK_ARRAY;
+		case DW_TAG_compile_unit:
+		case DW_TAG_type_unit:
+		case DW_TAG_formal_parameter:
+		case DW_TAG_lexical_block:
+		case DW_TAG_variable:
+		case DW_TAG_subprogram:
+		case DW_TAG_member:
+		case DW_TAG_subrange_type:	return TAG_NOT_TYPE;
+		default:					return TAG_SKIPPED;
 		}
-		dwarf_srclines_dealloc(dbg, linebuf, linecount);
-	} 
+	}
 
-	int print_info(Dwarf_Debug &dbg, bool src_lines_nfo) {
+	// Signatures are read as little endian numbers, as dwarfreader does.
+	uint64_t signature_value(const Dwarf_Sig8& signature) {
+		uint64_t value = 0;
+		for (int i = 7; i >= 0; --i)
+			value = value << 8 | (unsigned char)signature.signature[i];
+		return value;
+	}
 
+	// Units of .debug_info or of .debug_types.
+	void list_units(Dwarf_Debug dbg, Dwarf_Bool is_info,
+		std::vector<Dwarf_Off>& units, TypeUnits_t& type_units) {
 		Dwarf_Error_s *err;
 		Dwarf_Unsigned cu_header_length = 0;
 		Dwarf_Half version_stamp = 0;
@@ -786,141 +1327,2614 @@ dealloc_tag_name:
 		Dwarf_Sig8 signature;
 		Dwarf_Unsigned typeoffset = 0;
 		Dwarf_Unsigned next_cu_offset = 0;
-
-		MY_PRINT("[[Section .debug_info]]\n");
-
-		unsigned iteration = 0;
-		int nres = 0;
-		int sres = DW_DLV_OK;
 		Dwarf_Die cu_die = 0;
-		TypeContainer *tcon = 0;
-		// REF print_die.c : 400	
-		for (;;++iteration) {
-//			MY_PRINT("*\n");
+		Dwarf_Off offset = 0;
 
-			nres = dwarf_next_cu_header_c(dbg, 1, &cu_header_length,
+		// REF print_die.c : 400
+		for (;;) {
+			typeoffset = 0;
+			int nres = dwarf_next_cu_header_c(dbg, is_info, &cu_header_length,
 				&version_stamp, &abbrev_offset, &address_size,
 				&length_size, &extension_size, &signature,
 				&typeoffset, &next_cu_offset, &err);
+			if (DW_DLV_OK != nres)
+				return;
 
-			if (DW_DLV_NO_ENTRY == nres || DW_DLV_OK != nres)
-				return nres;
-
-			sres = dwarf_siblingof_b(dbg, NULL, 1, &cu_die, &err);
+			int sres = dwarf_siblingof_b(dbg, NULL, is_info, &cu_die, &err);
 			if (DW_DLV_OK != sres) {
 				MY_PRINT("error in reading siblings");
-				return sres;
+				continue;
 			}
-	
-			if (src_lines_nfo) {
-				print_line_numbers_info(dbg, cu_die);
-			} else {
-				Dwarf_Signed cnt = 0;
-				char **srcfiles = 0;
-				int srcf = dwarf_srcfiles(cu_die, &srcfiles, &cnt,
-					&err);
-				if (DW_DLV_OK != srcf) {
-					srcfiles = 0;
-					cnt = 0;
-				}
-				std::vector<std::string> srclist;
-				for (int j = 0; j < cnt; ++j) {
-					srclist.push_back(srcfiles[j]);
-				}
-
-				const char * filename = 0;
-				print_die_and_children(dbg, cu_die, 1, srcfiles,
-					&filename, cnt, srclist, &tcon);
-				if (DW_DLV_OK == srcf) {
-					for (int si = 0; si < cnt; ++si)
-						dwarf_dealloc(dbg, srcfiles[si], DW_DLA_STRING);
-					dwarf_dealloc(dbg, srcfiles, DW_DLA_LIST);
+			if (DW_DLV_OK == dwarf_dieoffset(cu_die, &offset, &err)) {
+				if (!is_info)
+					offset |= dwarfreader::TYPES_UNIT;
+				units.push_back(offset);
+				// Only type units have the offset of their type.
+				if (0 != typeoffset) {
+					type_units[offset] = std::make_pair(
+						signature_value(signature), uint64_t(typeoffset));
 				}
 			}
 			dwarf_dealloc(dbg, cu_die, DW_DLA_DIE);
 			cu_die = 0;
 		}
-		delete tcon;
-	};
+	}
+
+	// Lists offsets of the DIEs of all units, of .debug_info and then of
+	// .debug_types marked as dwarfreader does (@sa dwarfreader::units()),
+	// and the type units among them.
+	void list_units(Dwarf_Debug dbg, std::vector<Dwarf_Off>& units,
+		TypeUnits_t& type_units) {
+		list_units(dbg, true, units, type_units);
+		list_units(dbg, false, units, type_units);
+	}
+}
+
 
-	int collect_vars_info(Elf * elf) {
-		Dwarf_Debug dbg;
+namespace {
+	// Lists full paths of the source files of the unit, the same way
+	// they are given to variables (@sa VarInfo::Imp::CU::get_attribute).
+	void unit_files(Dwarf_Debug dbg, Dwarf_Die cu_die,
+		std::vector<std::string>& files) {
 		Dwarf_Error_s *err;
-		int dres = dwarf_elf_init(elf, DW_DLC_READ, NULL, NULL, &dbg, &err);
-		if (DW_DLV_NO_ENTRY == dres) {
-			MY_PRINT("No DWARF information.\n");
-			return 0;
+		std::string comp_dir;
+		Dwarf_Attribute attr = 0;
+		if (DW_DLV_OK == dwarf_attr(cu_die, DW_AT_comp_dir, &attr, &err)) {
+			char *name = 0;
+			if (DW_DLV_OK == dwarf_formstring(attr, &name, &err)) {
+				comp_dir = name;
+				dwarf_dealloc(dbg, name, DW_DLA_STRING);
+			}
+			dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
 		}
-		if (DW_DLV_OK != dres) {
-			MY_PRINT("error reading DWARF info\n");
-			return 0;
+		char **srcfiles = 0;
+		Dwarf_Signed cnt = 0;
+		if (DW_DLV_OK != dwarf_srcfiles(cu_die, &srcfiles, &cnt, &err))
+			return;
+		for (Dwarf_Signed i = 0; i < cnt; ++i) {
+			if ('/' == srcfiles[i][0])
+				files.push_back(srcfiles[i]);
+			else
+				files.push_back(comp_dir + '/' + srcfiles[i]);
+			dwarf_dealloc(dbg, srcfiles[i], DW_DLA_STRING);
 		}
-	
-		print_info(dbg, /*gather_lines_info=*/true);
-		print_info(dbg, false);	
+		dwarf_dealloc(dbg, srcfiles, DW_DLA_LIST);
+	}
 
-		dwarf_finish(dbg, &err);
-		return 1;
-	};
+	// Same with the built-in reader.
+	void unit_files(const dwarfreader::unit& u, std::vector<std::string>& files) {
+		const std::string comp_dir = u.comp_dir();
+		std::vector<std::string> srcfiles;
+		unsigned first = 0;
+		if (!u.files(srcfiles, first))
+			return;
+		for (auto f = srcfiles.begin(); srcfiles.end() != f; ++f) {
+			if ('/' == (*f)[0])
+				files.push_back(*f);
+			else
+				files.push_back(comp_dir + '/' + *f);
+		}
+	}
 
-	int parse_debug_info(int fd) {
+	// Offset of a member given by a location expression, which is
+	// DW_OP_plus_uconst for members at constant offsets.
+	bool member_offset(const unsigned char *expr, uint64_t size,
+		uint64_t& offset) {
+		if (0 == size || DW_OP_plus_uconst != expr[0])
+			return false;
+		offset = 0;
+		for (uint64_t i = 1, shift = 0; i < size && shift < 64; ++i, shift += 7) {
+			offset |= uint64_t(expr[i] & 0x7f) << shift;
+			if (!(expr[i] & 0x80))
+				return true;
+		}
+		return false;
+	}
 
-		if (elf_version(EV_CURRENT) == EV_NONE) {
-			MY_PRINT("libelf.a is out of date\n");
+	// Units are read by the same code with libdwarf and with the built-in
+	// reader, the adapters below give libdwarf DIEs and attributes the
+	// interface of dwarfreader (@sa VarInfo::Imp::CU::read_die).
+	class dwarf_attribute {
+	public:
+		dwarf_attribute(Dwarf_Debug dbg, Dwarf_Die die, Dwarf_Attribute attr) :
+			_dbg(dbg), _die(die), _attr(attr), _block(0) {};
+		~dwarf_attribute() {
+			if (!!_block)
+				dwarf_dealloc(_dbg, _block, DW_DLA_BLOCK);
 		}
 
-		Elf * elf = elf_begin(fd, ELF_C_READ, NULL);
-		if (ELF_K_AR == elf_kind(elf)) {
-			MY_PRINT("the file is an archieve\n");
-			close(fd);
-			return 0;
+		Dwarf_Half form() const {
+			Dwarf_Error_s *err;
+			Dwarf_Half form = 0;
+			return DW_DLV_OK == dwarf_whatform(_attr, &form, &err) ? form : 0;
 		}
-		Elf *f_elf = elf;
-		// FIXME: check the there is an ELF32 or ELF64 header
-		Elf_Cmd cmd = ELF_C_READ;
-		while(0 != (elf = elf_begin(fd, cmd, elf))) {
-			collect_vars_info(elf);
-			cmd = elf_next(elf);
-			elf_end(elf);
+		bool udata(uint64_t& value) const {
+			Dwarf_Error_s *err;
+			Dwarf_Unsigned v = 0;
+			const bool ok = DW_DLV_OK == dwarf_formudata(_attr, &v, &err);
+			value = v;
+			return ok;
 		}
-		elf_end(f_elf);
-		return 1;
-	};
-
-	bool read_file_debug(const char * file) {	
-		int fd = open(file, O_RDWR);
-		if (-1 == fd) {
-			MY_PRINT("cannot find the file to open..\n");
-			return false;
+		bool sdata(int64_t& value) const {
+			Dwarf_Error_s *err;
+			Dwarf_Signed v = 0;
+			const bool ok = DW_DLV_OK == dwarf_formsdata(_attr, &v, &err);
+			value = v;
+			return ok;
 		}
-
-		struct stat elf_stats;
-		if ((fstat(fd, &elf_stats))) {
-			MY_PRINT("cannot stat the file\n");
-			return false;
+		// The string points into the section, it is not freed.
+		bool string(const char *&value) const {
+			Dwarf_Error_s *err;
+			char *s = 0;
+			const bool ok = DW_DLV_OK == dwarf_formstring(_attr, &s, &err);
+			value = s;
+			return ok;
+		}
+		bool block(const unsigned char *&data, uint64_t& size) const {
+			Dwarf_Error_s *err;
+			Dwarf_Unsigned len = 0;
+			Dwarf_Ptr expr = 0;
+			if (DW_FORM_exprloc == form()) {
+				if (DW_DLV_OK != dwarf_formexprloc(_attr, &len, &expr, &err))
+					return false;
+			} else {
+				if (!_block && DW_DLV_OK != dwarf_formblock(_attr, &_block, &err)) {
+					_block = 0;
+					return false;
+				}
+				len = _block->bl_len;
+				expr = _block->bl_data;
+			}
+			data = (const unsigned char *)expr;
+			size = len;
+			return true;
+		}
+		bool ref(uint64_t& offset) const {
+			Dwarf_Error_s *err;
+			Dwarf_Off v = 0;
+			const bool ok = DW_DLV_OK == dwarf_formref(_attr, &v, &err);
+			offset = v;
+			return ok;
+		}
+		bool signature(uint64_t& value) const {
+			Dwarf_Error_s *err;
+			Dwarf_Sig8 v;
+			if (DW_DLV_OK != dwarf_formsig8(_attr, &v, &err))
+				return false;
+			value = signature_value(v);
+			return true;
+		}
+		bool addr(uint64_t& value) const {
+			Dwarf_Error_s *err;
+			Dwarf_Addr v = 0;
+			const bool ok = DW_DLV_OK == dwarf_formaddr(_attr, &v, &err);
+			value = v;
+			return ok;
+		}
+		bool address(uint64_t index, uint64_t& value) const {
+			Dwarf_Error_s *err;
+			Dwarf_Addr v = 0;
+			const bool ok = DW_DLV_OK ==
+				dwarf_debug_addr_index_to_addr(_die, index, &v, &err);
+			value = v;
+			return ok;
 		}
 
-		int e = parse_debug_info(fd);
-		close(fd);
-		return 1 == e;
-	}
-#endif // __linux
-};
+	private:
+		dwarf_attribute(const dwarf_attribute&);
+		dwarf_attribute& operator=(const dwarf_attribute&);
 
+		Dwarf_Debug _dbg;
+		Dwarf_Die _die;
+		Dwarf_Attribute _attr;
+		mutable Dwarf_Block *_block;
+	};
+
+	class dwarf_die {
+	public:
+		typedef dwarf_attribute attribute_type;
+
+		dwarf_die(Dwarf_Debug dbg, Dwarf_Die die) : _dbg(dbg), _die(die) {};
+
+		bool offset(Dwarf_Off& offset) const {
+			Dwarf_Error_s *err;
+			return DW_DLV_OK == dwarf_die_CU_offset(_die, &offset, &err);
+		}
+		// Calls 'f(attr, value)' for every attribute.
+		template<class F>
+		void attributes(F f) const {
+			Dwarf_Error_s *err;
+			Dwarf_Signed atcnt = 0;
+			Dwarf_Attribute *atlist = 0;
+			const int atres = dwarf_attrlist(_die, &atlist, &atcnt, &err);
+			if (DW_DLV_ERROR == atres)
+				MY_PRINT("Error while getting the attributes\n");
+			if (DW_DLV_OK != atres)
+				return;
+			for (Dwarf_Signed i = 0; i < atcnt; ++i) {
+				Dwarf_Half attr;
+				if (DW_DLV_OK != dwarf_whatattr(atlist[i], &attr, &err))
+					MY_PRINT("<Cannot get attributes>\n");
+				else {
+					const dwarf_attribute value(_dbg, _die, atlist[i]);
+					f(attr, value);
+				}
+				dwarf_dealloc(_dbg, atlist[i], DW_DLA_ATTR);
+			}
+			dwarf_dealloc(_dbg, atlist, DW_DLA_LIST);
+		}
+
+	private:
+		Dwarf_Debug _dbg;
+		Dwarf_Die _die;
+	};
+
+	class native_die {
+	public:
+		typedef dwarfreader::attribute attribute_type;
+
+		native_die(const dwarfreader::unit& u, const dwarfreader::die& die) :
+			_unit(u), _die(die) {};
+
+		bool offset(Dwarf_Off& offset) const {
+			offset = _die.offset;
+			return true;
+		}
+		template<class F>
+		void attributes(F f) const {
+			dwarfreader::attribute a;
+			for (dwarfreader::unit::attributes attrs(_unit, _die); attrs.next(a);)
+				f(a.name(), a);
+		}
+
+	private:
+		const dwarfreader::unit& _unit;
+		const dwarfreader::die& _die;
+	};
+}
+
+
+// Compressed (SHF_COMPRESSED, -gz) debug sections of the file, inflated
+// once and shared by all ELF handles of the file, so the threads and the
+// passes over the units don't inflate them again.
+class VarInfo::Imp::Inflated {
+public:
+	Inflated() : _compressed(0), _decompressed(0), _seconds(0) {};
+
+	// Inflates the sections of 'elf' on the first call, on 'threads'
+	// threads, and replaces the data of the sections of 'elf' with the
+	// inflated data. Must be called before libdwarf reads the sections.
+	void install(Elf *elf, unsigned threads, bool timed) {
+		std::call_once(_once, [this, elf, threads, timed]() {
+			phase_timer timer(timed, _seconds);
+			inflate(elf, threads);
+		});
+		for (auto s = _sections.begin(); _sections.end() != s; ++s) {
+			Elf_Scn *const scn = elf_getscn(elf, s->index);
+			GElf_Shdr shdr;
+			Elf_Data *const data = !scn ? 0 : elf_getdata(scn, 0);
+			if (!data || !gelf_getshdr(scn, &shdr))
+				continue;
+			data->d_buf = &s->data[0];
+			data->d_size = s->data.size();
+			data->d_type = ELF_T_BYTE;
+			data->d_align = 1;
+			// libdwarf must not see them as compressed.
+			shdr.sh_flags &= ~(GElf_Xword)SHF_COMPRESSED;
+			shdr.sh_size = s->data.size();
+			gelf_update_shdr(scn, &shdr);
+		}
+	}
+
+	size_t compressed() const { return _compressed; }
+	size_t decompressed() const { return _decompressed; }
+	double seconds() const { return _seconds; }
+
+private:
+	Inflated(const Inflated&);
+	Inflated& operator=(const Inflated&);
+
+	struct section_t {
+		size_t index;
+		const Bytef *source;	// the stream after the header
+		uLong source_size;
+		std::vector<char> data;
+	};
+
+	// Sections are inflated by whole ones, a zlib stream can't be split.
+	// Sections zlib can't inflate (zstd) are left to libdwarf.
+	void inflate(Elf *elf, unsigned threads) {
+		const char *const ident = elf_getident(elf, NULL);
+		if (!host_byte_order(elf))
+			return;
+		const bool is64 = ELFCLASS64 == ident[EI_CLASS];
+		size_t shstrndx = 0;
+		if (0 != elf_getshdrstrndx(elf, &shstrndx))
+			return;
+		for (Elf_Scn *scn = 0; !!(scn = elf_nextscn(elf, scn));) {
+			GElf_Shdr shdr;
+			if (!gelf_getshdr(scn, &shdr) || !(shdr.sh_flags & SHF_COMPRESSED))
+				continue;
+			const char *const name = elf_strptr(elf, shstrndx, shdr.sh_name);
+			Elf_Data *const raw = elf_rawdata(scn, 0);
+			if (!name || 0 != strncmp(name, ".debug_", 7) || !raw)
+				continue;
+			uint32_t type;
+			uint64_t size;
+			size_t header;
+			if (is64) {
+				Elf64_Chdr chdr;
+				header = sizeof(chdr);
+				if (raw->d_size < header)
+					continue;
+				memcpy(&chdr, raw->d_buf, header);
+				type = chdr.ch_type;
+				size = chdr.ch_size;
+			} else {
+				Elf32_Chdr chdr;
+				header = sizeof(chdr);
+				if (raw->d_size < header)
+					continue;
+				memcpy(&chdr, raw->d_buf, header);
+				type = chdr.ch_type;
+				size = chdr.ch_size;
+			}
+			if (ELFCOMPRESS_ZLIB != type || 0 == size)
+				continue;
+			section_t s;
+			s.index = elf_ndxscn(scn);
+			s.source = (const Bytef *)raw->d_buf + header;
+			s.source_size = raw->d_size - header;
+			s.data.resize(size);
+			_sections.push_back(std::move(s));
+		}
+		// The largest first, for the threads to finish together.
+		std::sort(_sections.begin(), _sections.end(),
+			[](const section_t& l, const section_t& r) {
+			return l.source_size > r.source_size;
+		});
+		std::vector<bool> inflated(_sections.size());
+		std::atomic<size_t> next(0);
+		auto worker = [this, &next, &inflated]() {
+			for (size_t i = next++; i < _sections.size(); i = next++) {
+				section_t& s = _sections[i];
+				uLongf size = s.data.size();
+				inflated[i] = Z_OK == uncompress((Bytef *)&s.data[0], &size,
+					s.source, s.source_size) && size == s.data.size();
+			}
+		};
+		std::vector<std::thread> workers;
+		for (size_t t = 1; t < std::min<size_t>(threads, _sections.size()); ++t)
+			workers.push_back(std::thread(worker));
+		worker();
+		for (auto t = workers.begin(); workers.end() != t; ++t)
+			t->join();
+		size_t kept = 0;
+		for (size_t i = 0; i < _sections.size(); ++i) {
+			if (!inflated[i]) {
+				MY_PRINT("Failed to inflate section %lu\n", (unsigned long)_sections[i].index);
+				continue;
+			}
+			_compressed += _sections[i].source_size;
+			_decompressed += _sections[i].data.size();
+			if (kept != i)
+				_sections[kept] = std::move(_sections[i]);
+			++kept;
+		}
+		_sections.resize(kept);
+	}
+
+	std::once_flag _once;
+	std::vector<section_t> _sections;
+	size_t _compressed;
+	size_t _decompressed;
+	double _seconds;
+};
+
+
+// DWARF handle of a thread, libdwarf handles can't be shared between
+// threads.
+class VarInfo::Imp::DwarfFile {
+public:
+	// With 'native' the file is read by the built-in reader if it can,
+	// libdwarf isn't even initialized then. With 'fingerprints' the
+	// built-in reader is kept to fingerprint the units whichever reads
+	// them (@sa VarInfo::Options::incremental).
+	DwarfFile(const std::string& path, Inflated& inflated, unsigned threads,
+		bool timed, bool native = false, bool fingerprints = false) :
+		_fd(-1), _elf(0), _dbg(0), _native(false) {
+		Dwarf_Error_s *err;
+		_fd = open(path.c_str(), O_RDONLY);
+		if (-1 == _fd)
+			return;
+		elf_version(EV_CURRENT);
+		_elf = elf_begin(_fd, ELF_C_READ_MMAP, NULL);
+		if (!_elf)
+			return;
+		inflated.install(_elf, threads, timed);
+		dwarfreader::section_t sections[dwarfreader::SECTIONS];
+		if ((native || fingerprints) && native_sections(_elf, sections)) {
+			_reader.reset(new dwarfreader());
+			if (!_reader->init(sections)) {
+				_reader.reset();
+				MY_PRINT("The built-in reader can't read %s\n", path.c_str());
+			} else if (native) {
+				_native = true;
+				return;
+			}
+		}
+		if (DW_DLV_OK != dwarf_elf_init(_elf, DW_DLC_READ, NULL, NULL, &_dbg, &err))
+			_dbg = 0;
+	}
+	~DwarfFile() {
+		Dwarf_Error_s *err;
+		if (!!_dbg)
+			dwarf_finish(_dbg, &err);
+		if (!!_elf)
+			elf_end(_elf);
+		if (-1 != _fd)
+			close(_fd);
+	}
+	Dwarf_Debug dbg() const { return _dbg; }
+	// The built-in reader, 0 if the file is read by libdwarf.
+	const dwarfreader *reader() const { return _native ? _reader.get() : 0; }
+	// The built-in reader to fingerprint the units with, 0 if none.
+	const dwarfreader *fingerprints() const { return _reader.get(); }
+private:
+	DwarfFile(const DwarfFile&);
+	DwarfFile& operator=(const DwarfFile&);
+
+	int _fd;
+	Elf *_elf;
+	Dwarf_Debug _dbg;
+	std::unique_ptr<dwarfreader> _reader;
+	bool _native;	// the units are read by _reader
+};
+
+
+// The rebuilt binary as reload() reads it before it takes the lock of the
+// lazy mode: the file, its units with their fingerprints and files, or
+// the index of the cache (@sa VarInfo::Imp::read_binary).
+struct VarInfo::Imp::Binary {
+	Binary() : opening(0), fingerprinting(0) {};
+
+	std::string path;	// @sa debug_file
+	std::unique_ptr<Inflated> inflated;
+	std::unique_ptr<DwarfFile> dwarf;
+	std::string key;	// @sa cache_file
+	std::string cache;
+	std::shared_ptr<snapshot> cached;	// the index of the cache if it has one
+	std::unordered_map<uint64_t, uint64_t> object_sizes;
+	std::vector<Dwarf_Off> units;
+	TypeUnits_t type_units;
+	std::vector<uint64_t> fingerprints;	// by unit, 0 - unknown
+	std::vector<std::vector<uint64_t> > statics;	// by unit (@sa dwarfreader::unit::fingerprint)
+	std::vector<std::vector<std::string> > files;	// by unit, the lazy mode only
+	double opening;
+	double fingerprinting;
+};
+
+
+// CU gathers variables and types of a single compilation unit. Units
+// don't share any state while being parsed, so they can be parsed in
+// parallel, and are merged into the data base in the order they follow
+// in .debug_info afterwards (@sa VarInfo::Imp::merge_cu).
+class VarInfo::Imp::CU {
+public:
+	typedef std::map<Dwarf_Addr, Dwarf_Unsigned> Lines_t;
+
+	CU(size_t id, const Types_t *const types, scoping::cache *const scopes,
+		const Filters *const filters) :
+		_id(id), _vars(&_strings, types), _dies(0), _skipped(0), _filtered(0),
+		_lines_time(0), _dies_time(0), _fingerprint_time(0), _fingerprint(0),
+		_signature(0), _type_offset(0), _types(types), _filters(filters),
+		_scoping(scopes), _first_file(1), _left_out(false),
+		_die_stack_indent_level(0), _vis_start_line(0), _vis_end_line(0),
+		_tcon(0), _specification(0) {};
+	~CU() { delete _tcon; }
+
+	// Collects variables and types of the unit in a single walk: the line
+	// table of the unit is read first to map the addresses met in its DIEs,
+	// and is dropped as soon as the DIEs are done. The phases are timed
+	// if 'timed'.
+	void read(Dwarf_Debug dbg, Dwarf_Die cu_die, const bool timed) {
+		{
+			phase_timer timer(timed, _lines_time);
+			print_line_numbers_info(dbg, cu_die);
+		}
+		phase_timer timer(timed, _dies_time);
+		read_dies(dbg, cu_die);
+		done();
+	}
+
+	// Same with the built-in reader.
+	void read(const dwarfreader::unit& u, const bool timed) {
+		u.type_unit(_signature, _type_offset);
+		{
+			phase_timer timer(timed, _lines_time);
+			uint64_t addr = 0, line = 0;
+			for (dwarfreader::unit::lines rows(u); rows.next(addr, line);)
+				_lines[addr] = line;
+		}
+		phase_timer timer(timed, _dies_time);
+		std::vector<std::string> srclist;
+		unsigned first = 1;
+		if (u.files(srclist, first))
+			_first_file = first;
+		else
+			srclist.clear();
+		const char *filename = 0;
+		uint64_t at = u.first();
+		read_dies(u, at, &filename, srclist);
+		done();
+	}
+
+	const size_t	_id;
+	std::string		_file;			// CU file name
+	Strings			_strings;		// names of _vars until merged
+	Vars_t			_vars;
+	BaseTypesFile_t	_base_types;
+	StructFields_t	_struct_fields;
+	size_t			_dies;			// DIEs walked
+	size_t			_skipped;		// of them not of interest
+	size_t			_filtered;		// variables and functions left out (@sa Filters)
+	double			_lines_time;	// seconds, if timed
+	double			_dies_time;
+	double			_fingerprint_time;
+	uint64_t		_fingerprint;	// 0 - unknown (@sa dwarfreader::unit::fingerprint)
+	std::vector<uint64_t> _statics;	// addresses left out of the fingerprint
+	uint64_t		_signature;		// of a type unit
+	uint64_t		_type_offset;	// of the type of a type unit, 0 in other units
+	std::vector<uint64_t> _signatures;	// referred to (@sa SIGNATURE_REF)
+
+private:
+	CU(const CU&);
+	CU& operator=(const CU&);
+
+	void read_dies(Dwarf_Debug dbg, Dwarf_Die cu_die) {
+		Dwarf_Error_s *err;
+		Dwarf_Signed cnt = 0;
+		char **srcfiles = 0;
+		std::vector<std::string> srclist;
+		if (DW_DLV_OK == dwarf_srcfiles(cu_die, &srcfiles, &cnt, &err)) {
+			for (int j = 0; j < cnt; ++j) {
+				srclist.push_back(srcfiles[j]);
+				dwarf_dealloc(dbg, srcfiles[j], DW_DLA_STRING);
+			}
+			dwarf_dealloc(dbg, srcfiles, DW_DLA_LIST);
+		}
+		// DWARF 5 numbers the files from 0, dwarf_srcfiles() lists them all.
+		Dwarf_Half version = 0, offset_size = 0;
+		if (DW_DLV_OK == dwarf_get_version_of_die(cu_die, &version, &offset_size) &&
+			version >= 5)
+			_first_file = 0;
+
+		const char * filename = 0;
+		print_die_and_children(dbg, cu_die,
+			dwarf_get_die_infotypes_flag(cu_die), &filename, srclist, &_tcon);
+	}
+
+	// The line table is of no use once the DIEs are read.
+	void done() {
+		Lines_t().swap(_lines);
+		// DIEs follow in the order of offsets, unless DWARF is unusual.
+		auto by_offset = [](const basetype_desc& l, const basetype_desc& r) {
+			return l.offset < r.offset;
+		};
+		if (!std::is_sorted(_base_types.begin(), _base_types.end(), by_offset))
+			std::stable_sort(_base_types.begin(), _base_types.end(), by_offset);
+		// Type units have no variables, their types are used by others.
+		if (!_filters->empty() && 0 == _type_offset)
+			drop_unused();
+	}
+
+	// Drops the variables of the types left out by the filters, then the
+	// types none of the variables left refers to, directly or by fields.
+	void drop_unused() {
+		if (!_filters->types.empty()) {
+			std::vector<bool> keep(_vars.size());
+			std::vector<const char*> names;
+			for (size_t i = 0; i < _vars.size(); ++i) {
+				// Types of type units aren't known yet, such variables
+				// are filtered once they are (@sa Imp::filter_vars).
+				keep[i] = !type_names(_vars[i].type_offset(), names) ||
+					_filters->types.pass(names);
+				_filtered += !keep[i];
+			}
+			_vars.compact(keep);
+		}
+
+		std::unordered_set<size_t> used;
+		std::vector<size_t> refs;
+		for (size_t i = 0; i < _vars.size(); ++i)
+			refs.push_back(_vars[i].type_offset());
+		while (!refs.empty()) {
+			const size_t offset = refs.back();
+			refs.pop_back();
+			const basetype_desc *const t = find_type(_base_types, offset);
+			if (!t || !used.insert(offset).second)
+				continue;
+			refs.push_back(t->next);
+			auto f = _struct_fields.find(type_key(_id, offset));
+			if (_struct_fields.end() == f)
+				continue;
+			for (auto i = f->second.begin(); f->second.end() != i; ++i)
+				refs.push_back(i->second.typeoffset);
+		}
+
+		delete _tcon;
+		_tcon = 0;
+		BaseTypesFile_t types;
+		for (auto t = _base_types.begin(); _base_types.end() != t; ++t) {
+			if (used.count(t->offset))
+				types.push_back(std::move(*t));
+		}
+		_base_types.swap(types);
+		for (auto f = _struct_fields.begin(); _struct_fields.end() != f;) {
+			if (used.count(uint32_t(f->first)))
+				++f;
+			else
+				f = _struct_fields.erase(f);
+		}
+	}
+
+	// Names met in the chain of types that starts at 'offset': typedefs
+	// and the type at the end of the chain. Returns false if the chain
+	// leaves the unit for a type unit.
+	bool type_names(size_t offset, std::vector<const char*>& names) const {
+		names.clear();
+		static const int max_refs = 256;
+		for (int i = max_refs; i > 0; --i) {
+			if (is_signature_ref(offset))
+				return false;
+			const basetype_desc *const t = find_type(_base_types, offset);
+			if (!t)
+				break;
+			if (!t->name.empty())
+				names.push_back(t->name.c_str());
+			offset = t->next;
+		}
+		return true;
+	}
+
+	// Refers to the type of a type unit by its signature.
+	size_t signature_ref(const uint64_t signature) {
+		auto s = _signature_refs.insert(std::make_pair(signature,
+			_signatures.size()));
+		if (s.second)
+			_signatures.push_back(signature);
+		return SIGNATURE_REF | s.first->second;
+	}
+
+	// Whether the source file of the number passes the filters, files
+	// are matched once per unit.
+	bool file_passes(const size_t number, const std::string& path) {
+		if (_file_passes.size() <= number)
+			_file_passes.resize(number + 1, -1);
+		if (-1 == _file_passes[number])
+			_file_passes[number] = _filters->files.pass(path.c_str());
+		return 1 == _file_passes[number];
+	}
+
+	Variable newVar() {
+		return _vars[_vars.add(_id)];
+	}
+
+	void cancelVar() {
+		_vars.pop_back();
+	}
+
+	basetype_desc& newBaseType(const size_t offset, TypeKind kind) {
+		_base_types.push_back(basetype_desc());
+		basetype_desc& t = _base_types.back();
+		t.offset = offset;
+		t.kind = kind;
+		return t;
+	}
+
+	Dwarf_Unsigned line_of(Dwarf_Addr addr) const {
+		auto l = _lines.find(addr);
+		return _lines.end() == l ? 0 : l->second;
+	}
+
+	// Required to gather all info about the structure (@sa StructFields_t)
+	struct TypeContainer {
+		bool		_valid;
+		unsigned _type_offset;
+		unsigned _field_type_offset;
+		std::string _fieldname;
+		int			_offset;
+		FieldsNames_t *_fields;
+		basetype_desc *_basetype;
+	};
+
+	const Types_t *const _types;
+	const Filters *const _filters;
+	Lines_t		_lines;			// addresses of the unit to lines
+	std::string _comp_dir;
+	scoping		_scoping;
+	unsigned	_first_file;	// number of the first source file
+	std::vector<signed char> _file_passes;	// by file number, -1 - not matched yet
+	bool		_left_out;		// the current DIE is declared in a file left out
+
+	int _die_stack_indent_level;	// nesting level of the current DIEs
+	int _vis_start_line;			// line where the current scope starts
+	int _vis_end_line;				// line where the current scope ends
+	TypeContainer *_tcon;			// structure being read
+
+	// Definitions of variables declared elsewhere in the unit only refer
+	// to the declaration and give the address.
+	Dwarf_Off	_specification;		// of the current DIE or 0
+	std::unordered_map<Dwarf_Off, size_t> _declarations;	// _vars by DIE offset
+	std::unordered_map<uint64_t, size_t> _signature_refs;	// in _signatures
+
+	template<class Attr>
+	void get_attribute(Dwarf_Half tag, Dwarf_Half attr, const Attr& value,
+		int die_indent_level, const std::vector<std::string>& srclist,
+		const char **const cfile, Variable *const var = 0,
+		basetype_desc *const basetype = 0, TypeContainer ** tcon = 0) {
+
+		#define SAY_AND_GO(x)	{ assert(false && x); MY_PRINT(x); }
+
+#ifdef DEBUG_PRINT
+		{
+			const char *v = "<unknown>";
+			const char *form = "<unknown>";
+			dwarf_get_AT_name(attr, &v);
+			dwarf_get_FORM_name(value.form(), &form);
+			MY_PRINT("%*s%s : [%s]", 2 * die_indent_level, " ", v, form);
+		}
+#endif // DEBUG_PRINT
+
+		switch (attr) {
+		case DW_AT_data_member_location: {
+			// DWARF 4 gives the offset as a constant, earlier versions
+			// as a location expression.
+			uint64_t uval = 0;
+			const unsigned char *expr = 0;
+			uint64_t len = 0;
+			if (!value.udata(uval) &&
+				(!value.block(expr, len) || !member_offset(expr, len, uval))) {
+				MY_PRINT("failed to read data member location");
+				goto dealloc_form;
+			}
+			const int offset = uval;
+
+			MY_PRINT("%d", offset);
+
+			if (!!(*tcon) && (*tcon)->_valid) {
+				(*tcon)->_offset = offset;
+				(*(*tcon)->_fields)[offset].name = (*tcon)->_fieldname;
+				(*(*tcon)->_fields)[offset].typeoffset = (*tcon)->_field_type_offset;
+				MY_PRINT("@FIELD: [%d] off=%d field=%s fieldtype=%d\n",
+					(*tcon)->_type_offset, offset,
+					(*tcon)->_fieldname.c_str(),
+					(*tcon)->_field_type_offset);
+			}
+			break;
+		}
+		case DW_AT_comp_dir: {
+			const char *name = 0;
+			if (!value.string(name)) { MY_PRINT("failed to read string attribute\n"); goto dealloc_form; }
+			_file = std::string() + name + '/' + _file;
+			*cfile = _file.c_str();	
+			MY_PRINT("\"%s\" ", name);
+			_comp_dir = name;
+			_scoping.init(srclist, _comp_dir + '/');
+			break;
+		}
+		case DW_AT_name: {
+			const char *name = 0;
+			if (!value.string(name)) { MY_PRINT("failed to read string attribute\n"); goto dealloc_form; }
+			if (0 == die_indent_level)
+				_file = name;
+			MY_PRINT("\"%s\" ", name);
+			if (!!var) {
+				var->setName(name);
+				var->setVisEndLine(_vis_end_line);
+			} else if (!!basetype) {
+				basetype->name = name;
+			}
+			if (!!(*tcon) && (*tcon)->_valid) {
+				(*tcon)->_fieldname = name;
+			}
+			break;
+		}
+		case DW_AT_decl_file:
+		case DW_AT_call_file: {
+			int64_t val = 0;
+			uint64_t uval = 0;
+			if (!value.udata(uval)) {
+				if (!value.sdata(val)) { SAY_AND_GO("failed to read data attribute\n"); goto dealloc_form; }
+				uval = (uint64_t)val;
+			}
+			// File numbers start with 1 before DWARF 5 (@sa _first_file).
+			if (uval < _first_file || uval - _first_file >= srclist.size()) {
+				MY_PRINT("no file %llu\n", (unsigned long long)uval);
+				goto dealloc_form;
+			}
+			*cfile = srclist[uval - _first_file].c_str();
+			std::string full_path = *cfile;
+			if ('/' != full_path[0]) {
+				full_path = _comp_dir + '/' + full_path;
+				//printf("%s\n", full_path.c_str());
+			}
+			if (!!var)
+				var->setFile(full_path);
+			if (DW_AT_decl_file == attr && !_filters->files.empty())
+				_left_out = !file_passes(uval - _first_file, full_path);
+			MY_PRINT("\"%s\" ", *cfile);
+			break;
+		}
+		case DW_AT_decl_line: {
+			int64_t val = 0;
+			uint64_t uval = 0;
+			if (!value.udata(uval)) {
+				if (!value.sdata(val)) { SAY_AND_GO("failed to read data attribute\n"); goto dealloc_form; }
+				uval = (uint64_t)val;	
+			}
+			MY_PRINT("\"%llu\" ", (unsigned long long)uval);
+			if (DW_TAG_formal_parameter == tag && !!var)
+				uval = _scoping.nextScope(var->file(), uval);
+			if (!!var)
+				var->setLine(uval);
+			break;
+		}
+		case DW_AT_upper_bound:
+		case DW_AT_byte_size: {
+			uint64_t val = 0;
+			if (!value.udata(val)) { SAY_AND_GO("failed to read data attribute\n"); goto dealloc_form; }
+			MY_PRINT("\"%llu\"", (unsigned long long)val);
+			if (DW_AT_byte_size == attr && !!basetype) {
+				basetype->size = val;
+			}
+			if (DW_AT_upper_bound == attr) {
+				if (!!tcon && !!*tcon) {
+					(*tcon)->_basetype->count = val;
+				}
+			}
+			break;
+		}
+		case DW_AT_location: {
+			if (!var || DW_TAG_variable != tag)
+				break;
+			// Locals are located by lists and expressions relative to
+			// registers, only static storage is a single DW_OP_addr, or
+			// DW_OP_addrx into the address table of the unit.
+			const unsigned char *op = 0;
+			uint64_t len = 0, addr = 0;
+			bool indexed = false;
+			if (!value.block(op, len)) { MY_PRINT("not a location expression\n"); goto dealloc_form; }
+			if (dwarfreader::static_location(op, len, addr, indexed) &&
+				(!indexed || value.address(addr, addr))) {
+				var->setAddress(addr);
+				MY_PRINT("\"0x%08llx\" ", (unsigned long long)addr);
+			}
+			break;
+		}
+		case DW_AT_signature: {
+			// Types of type units are declared in the units using them
+			// and refer to the definition by the signature.
+			uint64_t signature = 0;
+			if (!value.signature(signature)) { MY_PRINT("failed to read signature attribute\n"); goto dealloc_form; }
+			if (!!basetype)
+				basetype->next = signature_ref(signature);
+			MY_PRINT("<0x%016llx> ", (unsigned long long)signature);
+			break;
+		}
+		case DW_AT_specification: {
+			uint64_t offset = 0;
+			if (!value.ref(offset)) { MY_PRINT("failed to read ref attribute\n"); goto dealloc_form; }
+			_specification = offset;
+			MY_PRINT("<0x%08llu> ", (unsigned long long)offset);
+			break;
+		}
+		case DW_AT_low_pc:
+		case DW_AT_high_pc: {
+			uint64_t addr = 0;
+			if (!value.addr(addr)) {
+				MY_PRINT("failed to read address attribute\n");
+				goto dealloc_form;
+			}
+			if (DW_AT_low_pc == attr)
+				_vis_start_line = line_of(addr);
+			if (DW_AT_high_pc == attr)
+				_vis_end_line = line_of(addr);
+			MY_PRINT("line:%llu \"0x%08llx\" ",
+				line_of(addr), (unsigned long long)addr);
+			break;
+		}
+		case DW_AT_type: {
+			uint64_t offset = 0, signature = 0;
+			if (value.signature(signature)) {
+				offset = signature_ref(signature);
+			} else if (!value.ref(offset)) {
+				MY_PRINT("failed to read ref attribute\n");
+				goto dealloc_form;
+			}
+			if (!!var) {
+				var->setTypeOffset(offset);
+			}
+			else if (!!basetype) {
+				basetype->next = offset;
+			}
+
+			if (!!(*tcon) && (*tcon)->_valid) {
+				(*tcon)->_field_type_offset = offset;
+			}	
+			MY_PRINT("<0x%08llu> ", (unsigned long long)offset);
+			break;
+		}
+		default:;
+		}
+		MY_PRINT("\n");
+dealloc_form:;
+	}
+
+	// Reads a DIE given by 'Die' (@sa dwarf_die, native_die), returns
+	// false if its children are of no interest.
+	template<class Die>
+	bool read_die(const Die& die, Dwarf_Half tag, int die_indent_level,
+		const char* *const cfile, const std::vector<std::string>& srclist,
+		TypeContainer ** tcon) {
+
+		++_dies;
+		const int kind = tag_kind(tag);
+		if (TAG_SKIPPED == kind) {
+			++_skipped;
+			return false;
+		}
+
+		Variable new_var, *var = 0;
+		basetype_desc *basetype = 0;
+		Dwarf_Off offset = 0;	
+#ifdef DEBUG_PRINT
+		const char * tagname = "<unknown>";
+		dwarf_get_TAG_name(tag, &tagname);
+#endif // DEBUG_PRINT
+
+		if (DW_TAG_subprogram == tag)
+			_vis_end_line = 0;
+
+		MY_PRINT("\n%*s[%d]%s ", 2 * die_indent_level, " ", die_indent_level, tagname);
+		if (!die.offset(offset)) {
+			MY_PRINT("Failed to get die CU offset\n");
+			return false;
+		}
+
+		if (DW_TAG_variable == tag || DW_TAG_formal_parameter == tag) {
+			new_var = newVar();
+			var = &new_var;
+			_specification = 0;
+		} else if (TAG_NOT_TYPE != kind) {
+			basetype = &newBaseType(offset, TypeKind(kind));
+		}
+
+		if (die_indent_level <= 1 && 
+			(DW_TAG_structure_type == tag ||
+			DW_TAG_class_type == tag ||
+			DW_TAG_array_type == tag)) {
+			delete (*tcon);
+			*tcon = new TypeContainer;
+			(*tcon)->_type_offset = offset;
+			(*tcon)->_fields = &_struct_fields[type_key(_id, (*tcon)->_type_offset)];
+			(*tcon)->_basetype = basetype;
+				//printf("=FIELDS: off=%d file=%s\n", (*tcon)->_type_offset, _file.c_str());
+
+		}
+		
+		if (!!(*tcon)) {
+			if (DW_TAG_member == tag)
+				(*tcon)->_valid = true;
+			else
+				(*tcon)->_valid = false;
+		}
+		MY_PRINT("<0x%08llu>\r\n", offset);
+
+		// Members and subranges only matter within a structure or an array.
+		if (!(*tcon) && (DW_TAG_member == tag || DW_TAG_subrange_type == tag))
+			return true;
+
+		typedef typename Die::attribute_type Attr;
+		_left_out = false;
+		die.attributes([&](Dwarf_Half attr, const Attr& value) {
+			MY_PRINT("%*s", 2 * die_indent_level + 1, " ");
+			get_attribute(tag, attr, value, die_indent_level,
+				srclist, cfile, var, basetype, tcon);
+		});
+
+		// Variables and functions of the files left out by the filters are
+		// dropped right away, functions with all their variables. Types
+		// are kept until it is known which of them the variables use.
+		if (_left_out && (!!var || DW_TAG_subprogram == tag)) {
+			if (!!var)
+				cancelVar();
+			++_filtered;
+			return false;
+		}
+
+		if (!!var) {
+			if (size_t(Variable::VALUE_NOT_SET) == var->line() ||
+				VarInfo::NO_HANDLE == var->name_id()) {
+				auto d = _declarations.find(_specification);
+				if (Variable::NO_ADDRESS != var->address() &&
+					_declarations.end() != d)
+					_vars[d->second].setAddress(var->address());
+				cancelVar();
+				return true;
+			}
+			if (DW_TAG_variable == tag)
+				_declarations[offset] = _vars.size() - 1;
+			// Fix the end line of the scope as debugging info
+			// often gives incorrect values.
+			std::pair<int, int> ranges = _scoping.scope(var->file(),
+				var->line());
+			var->setVisEndLine(ranges.second);
+			MY_PRINT("@VARIABLE: [%lu] \"%s\" %lu-%lu (%s)\n",
+				var->type_offset(),
+				var->name().c_str(),
+				var->line(), var->visEndsLine(),
+				var->file().c_str());
+		}
+		else if (!!basetype) {
+			MY_PRINT("@BASETYPE: %llu[%s] -> %ld \"%s\", size=%lu, count=%lu (%s)\n", offset,
+				tagname, (long)basetype->next, basetype->name.c_str(),
+				basetype->size, basetype->count, _file.c_str());
+		}
+		return true;
+	}
+
+	void print_die_and_children(Dwarf_Debug dbg,
+		Dwarf_Die in_die_in, Dwarf_Bool is_info,
+		const char **const cfile, const std::vector<std::string>& srclist, TypeContainer **tcon = 0) {
+
+		Dwarf_Die in_die = in_die_in;
+		Dwarf_Error_s *err;
+		Dwarf_Die child = 0;
+		Dwarf_Die sibling = 0;
+		Dwarf_Half tag = 0;
+
+		int cdres = 0;
+
+		for (;;) {
+			if (DW_DLV_OK != dwarf_tag(in_die, &tag, &err)) {
+				MY_PRINT("Failed to obtain the tag\n");
+			} else if (read_die(dwarf_die(dbg, in_die), tag,
+				_die_stack_indent_level, cfile, srclist, tcon)) {
+				
+				cdres = dwarf_child(in_die, &child, &err);
+	
+				if (DW_DLV_OK == cdres) {
+					++_die_stack_indent_level;
+					print_die_and_children(dbg, child, is_info,
+						cfile, srclist, tcon);
+					--_die_stack_indent_level;
+					dwarf_dealloc(dbg, child, DW_DLA_DIE);
+					child = 0;
+				}
+				else if (DW_DLV_ERROR == cdres) {
+					MY_PRINT("Error while obtaining a child\n");
+					return;
+				}
+			}
+		
+			cdres = dwarf_siblingof_b(dbg, in_die, is_info, &sibling, &err);
+			if (DW_DLV_ERROR == cdres) {
+				MY_PRINT("Failed to get a sibling\n");
+				return;
+			}
+
+			if (in_die != in_die_in) {
+				dwarf_dealloc(dbg, in_die, DW_DLA_DIE);
+				in_die = 0;
+			}
+			if (DW_DLV_OK == cdres)
+				in_die = sibling;
+			else
+				break;
+		}
+	}
+
+	// Same walk with the built-in reader: from 'at' to the end of the list
+	// of siblings, the unit DIE has none. DIEs which children are of no
+	// interest are skipped with their children.
+	bool read_dies(const dwarfreader::unit& u, uint64_t& at,
+		const char **const cfile, const std::vector<std::string>& srclist) {
+		for (;;) {
+			dwarfreader::die d;
+			if (!u.next(at, d)) {
+				MY_PRINT("Broken DIE at %llu\n", (unsigned long long)at);
+				return false;
+			}
+			if (0 == d.tag)
+				return true;
+			const bool children = read_die(native_die(u, d), d.tag,
+				_die_stack_indent_level, cfile, srclist, &_tcon);
+			if (d.children && children) {
+				++_die_stack_indent_level;
+				const bool read = read_dies(u, at, cfile, srclist);
+				--_die_stack_indent_level;
+				if (!read)
+					return false;
+			} else if (d.children && !u.skip_children(d, at)) {
+				return false;
+			}
+			if (0 == _die_stack_indent_level)
+				return true;
+		}
+	}
+
+	
+	void print_line_numbers_info(Dwarf_Debug dbg, Dwarf_Die cu_die) {
+
+		Dwarf_Error_s *err;
+		Dwarf_Line *linebuf = NULL;
+		Dwarf_Signed linecount = 0;
+
+		int lres = dwarf_srclines(cu_die, &linebuf,
+			&linecount, &err);
+		switch(lres) {
+		case DW_DLV_ERROR:
+			MY_PRINT("Error in reading line numbers information\n");
+			return;
+		case DW_DLV_NO_ENTRY:
+			MY_PRINT("No line numbers information\n");
+			return;
+		default:;
+		}
+
+		int ares = 0, sres = 0;
+		Dwarf_Addr pc = 0;
+		Dwarf_Unsigned lineno = 0;
+		char * filename = 0;
+		for (Dwarf_Signed i = 0; i < linecount; ++i) {
+			Dwarf_Line line = linebuf[i];
+			filename = (char *)"<unknown>";
+			sres = dwarf_linesrc(line, &filename, &err);
+			if (DW_DLV_ERROR == sres) {
+				MY_PRINT("cannot read a source file that corresponds " 
+					"to the line\n");
+			} else {
+				ares = dwarf_lineaddr(line, &pc, &err);
+			}
+			if (DW_DLV_ERROR == ares) {
+				MY_PRINT("failed to obtain source - pc association\n");
+				continue;
+			}
+			ares = dwarf_lineno(line, &lineno, &err);
+			
+			if (DW_DLV_ERROR == ares) {
+				MY_PRINT("failed to get a line number for the pc addr\n");
+				continue;
+			}
+			if (DW_DLV_NO_ENTRY == ares)
+				continue;
+			
+			_lines[pc] = lineno;
+
+			if (DW_DLV_OK == sres)
+				dwarf_dealloc(dbg, filename, DW_DLA_STRING);
+		}
+		dwarf_srclines_dealloc(dbg, linebuf, linecount);
+	} 
+};
+
+
+// Calls 'job(dbg, cu_die, i)' for every unit of 'units' on _threads
+// threads. The calling thread uses 'dbg' and the others open 'path', the
+// file of 'dbg' with its sections 'inflated', on their own, the time it
+// takes is added to 'open'.
+template<class Job>
+void VarInfo::Imp::for_each_unit(Dwarf_Debug dbg, const std::string& path,
+	Inflated& inflated, double& open, const std::vector<Dwarf_Off>& units,
+	Job job) {
+
+	std::atomic<size_t> next(0);
+	auto worker = [&units, &next, &job](Dwarf_Debug d) {
+		Dwarf_Error_s *err;
+		for (size_t i = next++; i < units.size(); i = next++) {
+			Dwarf_Die cu_die = 0;
+			const Dwarf_Off types = dwarfreader::TYPES_UNIT;
+			if (DW_DLV_OK != dwarf_offdie_b(d, units[i] & ~types,
+				!(units[i] & types), &cu_die, &err)) {
+				MY_PRINT("Failed to get the unit at %llu\n", units[i]);
+				continue;
+			}
+			job(d, cu_die, i);
+			dwarf_dealloc(d, cu_die, DW_DLA_DIE);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	const size_t nthreads = std::min<size_t>(_threads, units.size());
+	std::vector<double> opened(nthreads);
+	for (size_t t = 1; t < nthreads; ++t) {
+		threads.push_back(std::thread([this, &path, &inflated, &worker, &opened, t]() {
+			std::unique_ptr<DwarfFile> file;
+			{
+				phase_timer timer(_timed, opened[t]);
+				file.reset(new DwarfFile(path, inflated, _threads, _timed));
+			}
+			if (!!file->dbg())
+				worker(file->dbg());
+		}));
+	}
+	worker(dbg);
+	for (auto t = threads.begin(); threads.end() != t; ++t)
+		t->join();
+	for (size_t t = 1; t < nthreads; ++t)
+		open += opened[t];
+}
+
+
+// Same with the built-in reader, the threads share it.
+template<class Job>
+void VarInfo::Imp::for_each_unit(const dwarfreader& reader,
+	const std::vector<Dwarf_Off>& units, Job job) {
+
+	std::atomic<size_t> next(0);
+	auto worker = [&reader, &units, &next, &job]() {
+		for (size_t i = next++; i < units.size(); i = next++) {
+			const size_t u = reader.find(units[i]);
+			if (reader.units().size() == u) {
+				MY_PRINT("Failed to get the unit at %llu\n", units[i]);
+				continue;
+			}
+			job(dwarfreader::unit(reader, u), i);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t t = 1; t < std::min<size_t>(_threads, units.size()); ++t)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (auto t = threads.begin(); threads.end() != t; ++t)
+		t->join();
+}
+
+
+void VarInfo::Imp::merge_cu(CU& cu) {
+	assert(cu._id == _cu_files.size() && "Units are merged out of order");
+	_cu_files.push_back(cu._file);
+	_cu_fingerprints.push_back(cu._fingerprint);
+	_cu_statics.resize(cu._id + 1);
+	_cu_statics[cu._id].swap(cu._statics);
+	_vars.append(cu._vars);
+	_base_types.resize(cu._id + 1);
+	_base_types[cu._id].swap(cu._base_types);
+	for (auto s = cu._struct_fields.begin(); cu._struct_fields.end() != s; ++s)
+		_struct_fields[s->first].swap(s->second);
+	_cu_signatures.resize(cu._id + 1);
+	_cu_signatures[cu._id].swap(cu._signatures);
+	_cu_type_units.resize(cu._id + 1, false);
+	if (0 != cu._type_offset) {
+		_cu_type_units[cu._id] = true;
+		_signature_types[cu._signature] = type_key(cu._id, cu._type_offset);
+	}
+}
+
+
+// Parses the units and adds them to the data base, 'numbers' are
+// numbers of the units in .debug_info (@sa _cu_units). The units are read
+// by 'reader' if it is given, by libdwarf otherwise, and fingerprinted by
+// 'prints' if the parsing results are kept (0 - they stay unknown).
+void VarInfo::Imp::parse_units(Dwarf_Debug dbg, const dwarfreader *reader,
+	const dwarfreader *prints, const std::vector<Dwarf_Off>& units,
+	const std::vector<size_t>& numbers) {
+
+	const size_t first_cu = _cu_files.size();
+	const size_t first_var = _vars.size();
+	std::vector<std::unique_ptr<CU> > cus(units.size());
+	for (size_t i = 0; i < units.size(); ++i)
+		cus[i].reset(new CU(first_cu + i, &_types, &_scopes, &_filters));
+
+	const auto started = std::chrono::steady_clock::now();
+	const bool timed = _timed;
+	if (_incremental && !!prints) {
+		for_each_unit(*prints, units,
+			[&cus, timed](const dwarfreader::unit& u, size_t i) {
+			phase_timer timer(timed, cus[i]->_fingerprint_time);
+			cus[i]->_fingerprint = u.fingerprint(&cus[i]->_statics);
+		});
+	}
+	if (!!reader) {
+		for_each_unit(*reader, units,
+			[&cus, timed](const dwarfreader::unit& u, size_t i) {
+			cus[i]->read(u, timed);
+		});
+	} else {
+		for (size_t i = 0; i < units.size(); ++i) {
+			auto t = _type_units.find(units[i]);
+			if (_type_units.end() != t) {
+				cus[i]->_signature = t->second.first;
+				cus[i]->_type_offset = t->second.second;
+			}
+		}
+		for_each_unit(dbg, units, [&cus, timed](Dwarf_Debug d, Dwarf_Die cu_die, size_t i) {
+			cus[i]->read(d, cu_die, timed);
+		});
+	}
+	const std::chrono::duration<double> spent =
+		std::chrono::steady_clock::now() - started;
+	size_t dies = 0;
+	_stats.units += cus.size();
+	for (size_t i = 0; i < cus.size(); ++i) {
+		dies += cus[i]->_dies;
+		_stats.dies_visited += cus[i]->_dies;
+		_stats.dies_skipped += cus[i]->_skipped;
+		_stats.filtered += cus[i]->_filtered;
+		_stats.lines += cus[i]->_lines_time;
+		_stats.dies += cus[i]->_dies_time;
+		_stats.fingerprints += cus[i]->_fingerprint_time;
+		_cu_units.push_back(numbers[i]);
+		merge_cu(*cus[i]);
+		cus[i].reset();
+	}
+	MY_PRINT("[[%lu DIEs in %.3f s, %.0f DIEs/s]]\n", (unsigned long)dies,
+		spent.count(), dies / std::max(spent.count(), 1e-9));
+	(void)dies;
+
+	resolve_types(first_cu, first_var);
+}
+
+
+// Lists the units and the source files of each of them for the lazy
+// mode. Only the unit DIEs and the headers of the line tables are read.
+// Accelerator tables (.debug_names, .gdb_index) and .debug_aranges map
+// names and addresses to units, not source files, so they are of no use.
+bool VarInfo::Imp::scan_units() {
+	{
+		phase_timer timer(_timed, _stats.open);
+		_dwarf.reset(new DwarfFile(_path, *_inflated, _threads, _timed, _native,
+			_incremental));
+	}
+	const dwarfreader *const reader = _dwarf->reader();
+	if (!_dwarf->dbg() && !reader)
+		return false;
+	if (!!reader)
+		_units.assign(reader->units().begin(), reader->units().end());
+	else
+		list_units(_dwarf->dbg(), _units, _type_units);
+	_loaded.assign(_units.size(), false);
+	std::vector<std::vector<std::string> > files;
+	list_files(*_dwarf, _path, *_inflated, _stats.open, _units, files);
+	map_units(files);
+	return true;
+}
+
+
+// Lists the source files of each of the units of 'dwarf', opened of
+// 'path' (@sa for_each_unit).
+void VarInfo::Imp::list_files(const DwarfFile& dwarf, const std::string& path,
+	Inflated& inflated, double& open, const std::vector<Dwarf_Off>& units,
+	std::vector<std::vector<std::string> >& files) {
+	const dwarfreader *const reader = dwarf.reader();
+	files.assign(units.size(), std::vector<std::string>());
+	if (!!reader) {
+		for_each_unit(*reader, units,
+			[&files](const dwarfreader::unit& u, size_t i) {
+			unit_files(u, files[i]);
+		});
+	} else {
+		for_each_unit(dwarf.dbg(), path, inflated, open, units,
+			[&files](Dwarf_Debug d, Dwarf_Die cu_die, size_t i) {
+			unit_files(d, cu_die, files[i]);
+		});
+	}
+}
+
+
+// Maps source files to the units not loaded yet and loads the type units
+// for the lazy mode, 'files' are the files of _units (@sa list_files).
+void VarInfo::Imp::map_units(const std::vector<std::vector<std::string> >& files) {
+	const dwarfreader *const reader = _dwarf->reader();
+	_files = std::make_shared<lazy_files>();
+	for (size_t i = 0; i < files.size(); ++i) {
+		if (_loaded[i])
+			continue;
+		for (auto f = files[i].begin(); files[i].end() != f; ++f) {
+			if (!_filters.files.pass(f->c_str()))
+				continue;
+			std::vector<size_t>& units = _files->files[*f].units;
+			if (units.empty() || units.back() != i)
+				units.push_back(i);
+		}
+	}
 
-bool VarInfo::Imp::init(const std::string& file) {
+	// Types of type units may be used by any unit, they are loaded first.
+	std::vector<Dwarf_Off> types;
+	std::vector<size_t> numbers;
+	for (size_t i = 0; i < _units.size(); ++i) {
+		uint64_t signature = 0, offset = 0;
+		if (_loaded[i])
+			continue;
+		if (!!reader ? dwarfreader::unit(*reader, i).type_unit(signature, offset) :
+			_type_units.count(_units[i])) {
+			_loaded[i] = true;
+			types.push_back(_units[i]);
+			numbers.push_back(i);
+		}
+	}
+	if (!types.empty())
+		parse_units(_dwarf->dbg(), reader, _dwarf->fingerprints(), types, numbers);
+}
+
+
+// Loads the units which sources include the file, if not loaded yet.
+// Queries see the file loaded once the snapshot with its units is
+// published (@sa lazy_files).
+void VarInfo::Imp::load_units(const std::string& file) {
+	if (!_files)
+		return;
+	auto f = _files->files.find(file);
+	if (_files->files.end() == f || f->second.loaded)
+		return;
+	std::shared_ptr<snapshot> next;
+	{
+		phase_timer timer(_timed, _stats.total);
+		std::vector<Dwarf_Off> units;
+		std::vector<size_t> numbers;
+		const std::vector<size_t>& file_units = f->second.units;
+		for (auto u = file_units.begin(); file_units.end() != u; ++u) {
+			if (_loaded[*u])
+				continue;
+			_loaded[*u] = true;
+			units.push_back(_units[*u]);
+			numbers.push_back(*u);
+		}
+		if (!units.empty()) {
+			parse_units(_dwarf->dbg(), _dwarf->reader(), _dwarf->fingerprints(),
+				units, numbers);
+			next = build_index(std::string());
+		}
+	}
+	if (!!next)
+		publish(next);
+	f->second.loaded.store(true, std::memory_order_release);
+}
+
+
+int VarInfo::Imp::collect_vars_info(Elf * elf) {
+	Dwarf_Debug dbg;
+	Dwarf_Error_s *err;
+	int dres;
+	// The built-in reader also fingerprints the units libdwarf parses.
+	dwarfreader reader;
+	bool readable = false;
+	if (_native || _incremental) {
+		dwarfreader::section_t sections[dwarfreader::SECTIONS];
+		{
+			phase_timer timer(_timed, _stats.open);
+			_inflated->install(elf, _threads, _timed);
+			readable = native_sections(elf, sections) && reader.init(sections);
+		}
+		if (readable && _native) {
+			const std::vector<Dwarf_Off> units(reader.units().begin(),
+				reader.units().end());
+			std::vector<size_t> numbers(units.size());
+			for (size_t i = 0; i < units.size(); ++i)
+				numbers[i] = _cu_units.size() + i;
+			parse_units(0, &reader, &reader, units, numbers);
+			return 1;
+		}
+		if (!readable)
+			MY_PRINT("The built-in reader can't read the file\n");
+	}
+	{
+		phase_timer timer(_timed, _stats.open);
+		_inflated->install(elf, _threads, _timed);
+		dres = dwarf_elf_init(elf, DW_DLC_READ, NULL, NULL, &dbg, &err);
+	}
+	if (DW_DLV_NO_ENTRY == dres) {
+		MY_PRINT("No DWARF information.\n");
+		return 0;
+	}
+	if (DW_DLV_OK != dres) {
+		MY_PRINT("error reading DWARF info\n");
+		return 0;
+	}
+
+	MY_PRINT("[[Section .debug_info]]\n");
+	std::vector<Dwarf_Off> units;
+	list_units(dbg, units, _type_units);
+	std::vector<size_t> numbers(units.size());
+	for (size_t i = 0; i < units.size(); ++i)
+		numbers[i] = _cu_units.size() + i;
+	parse_units(dbg, 0, readable ? &reader : 0, units, numbers);
+
+	dwarf_finish(dbg, &err);
+	return 1;
+};
+
+int VarInfo::Imp::parse_debug_info(int fd) {
+
+	if (elf_version(EV_CURRENT) == EV_NONE) {
+		MY_PRINT("libelf.a is out of date\n");
+	}
+
+	Elf * elf;
+	{
+		phase_timer timer(_timed, _stats.open);
+		elf = elf_begin(fd, ELF_C_READ_MMAP, NULL);
+	}
+	if (ELF_K_AR == elf_kind(elf)) {
+		MY_PRINT("the file is an archieve\n");
+		close(fd);
+		return 0;
+	}
+	Elf *f_elf = elf;
+	// FIXME: check the there is an ELF32 or ELF64 header
+	Elf_Cmd cmd = ELF_C_READ_MMAP;
+	while(0 != (elf = elf_begin(fd, cmd, elf))) {
+		collect_vars_info(elf);
+		cmd = elf_next(elf);
+		elf_end(elf);
+	}
+	elf_end(f_elf);
+	return 1;
+};
+
+bool VarInfo::Imp::read_file_debug(const char * file) {
+	int fd = open(file, O_RDONLY);
+	if (-1 == fd) {
+		MY_PRINT("cannot find the file to open..\n");
+		return false;
+	}
+
+	struct stat elf_stats;
+	if ((fstat(fd, &elf_stats))) {
+		MY_PRINT("cannot stat the file\n");
+		return false;
+	}
+
+	int e = parse_debug_info(fd);
+	close(fd);
+	return 1 == e;
+}
+
+
+// Path of the kept index of the binary and the key it is kept by, empty
+// ones if indices aren't kept (@sa VarInfo::Options::cache_dir).
+std::string VarInfo::Imp::cache_file(const std::string& file,
+	std::string& key) const {
+	key.clear();
+	if (_cache_dir.empty())
+		return std::string();
+	key = binary_key(file);
+	// The debug file of a binary without build id may change alone.
+	if (0 != key.compare(0, 9, "build-id:") && _path != file)
+		key += '|' + binary_key(_path);
+	// A binary without build id rebuilt in place replaces its index.
+	const bool build_id = 0 == key.compare(0, 9, "build-id:");
+	key += _filters.key();
+	return _cache_dir + '/' + std::to_string(
+		hasher(build_id ? key : file + _filters.key())) + ".varindex";
+}
+#endif // __linux
+
+
+bool VarInfo::Imp::init(const std::string& file, const VarInfo::Options& options) {
 #ifdef __linux
-	_file = file;
-	_die_stack_indent_level = 0;
-	return read_file_debug(file.c_str());
+	_timed = options.stats;
+	_native = options.native;
+	_incremental = options.incremental || options.lazy;
+	_debug_dir = options.debug_dir;
+	_cache_dir = options.cache_dir;
+	_filters.files = globs(options.include_files, options.exclude_files);
+	_filters.types = globs(options.include_types, options.exclude_types);
+	_threads = options.threads;
+	if (0 == _threads)
+		_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::shared_ptr<snapshot> next;
+	bool res;
+	{
+		phase_timer timer(_timed, _stats.total);
+		res = build(file, options.lazy, next);
+	}
+	if (!!next)
+		publish(next);
+	return res;
 #else // __linux
+	(void)file;
+	(void)options;
 	return false; // NOT_IMPLEMENTED
 #endif // __linux
 };
 
 
+#ifdef __linux
+// Builds the first snapshot, of the cache if it has one for the binary.
+bool VarInfo::Imp::build(const std::string& file, const bool lazy,
+	std::shared_ptr<snapshot>& next) {
+
+	_path = debug_file(file, _debug_dir);
+	_inflated.reset(new Inflated());
+	std::string key;
+	const std::string cache = cache_file(file, key);
+	next.reset(new snapshot);
+	if (!key.empty() && next->index.open(cache, key)) {
+		next->make_paths();
+		return true;
+	}
+	// Fully stripped binaries keep the symbol table in the debug file.
+	object_sizes(_path, _object_sizes);
+	if (_object_sizes.empty() && _path != file)
+		object_sizes(file, _object_sizes);
+	if (lazy && scan_units()) {
+		_lazy = true;
+		next = build_index(std::string());
+		return true;
+	}
+	const bool res = read_file_debug(_path.c_str());
+	next = build_index(key);
+	if (res && !key.empty() && !next->index.save(cache))
+		MY_PRINT("Failed to write the index to %s\n", cache.c_str());
+	return res;
+}
+#endif // __linux
+
+
+// The next snapshot is built aside and published once ready, queries go
+// on with the current one meanwhile. The binary is read before the lock
+// of the lazy mode is taken, its queries only wait while the units read
+// replace the ones loaded and the index is built.
+bool VarInfo::Imp::reload(const std::string& file) {
+#ifdef __linux
+	std::lock_guard<std::mutex> reloading(_reload_mutex);
+	Binary binary;
+	double reading = 0;
+	bool res;
+	{
+		phase_timer timer(_timed, reading);
+		res = read_binary(file, binary);
+	}
+	if (!res)
+		return false;
+	auto lock = lock_lazy();
+	_stats = VarInfo::Stats();
+	_stats.total = reading;
+	std::shared_ptr<snapshot> next;
+	{
+		phase_timer timer(_timed, _stats.total);
+		rebuild(binary, next);
+	}
+	++_generation;
+	publish(next);
+	return true;
+#else // __linux
+	(void)file;
+	return false; // NOT_IMPLEMENTED
+#endif // __linux
+}
+
+
+#ifdef __linux
+// Opens the binary, takes its units and fingerprints them, touches
+// nothing the queries use. Both readers list the units at the same
+// offsets, the built-in one fingerprints them whichever parses.
+bool VarInfo::Imp::read_binary(const std::string& file, Binary& binary) {
+	binary.path = debug_file(file, _debug_dir);
+	binary.inflated.reset(new Inflated());
+	{
+		phase_timer timer(_timed, binary.opening);
+		binary.dwarf.reset(new DwarfFile(binary.path, *binary.inflated,
+			_threads, _timed, _native, _incremental));
+	}
+	const dwarfreader *const reader = binary.dwarf->reader();
+	if (!binary.dwarf->dbg() && !reader)
+		return false;
+
+	binary.cache = cache_file(file, binary.key);
+	if (!_incremental && !binary.key.empty()) {
+		binary.cached.reset(new snapshot);
+		if (binary.cached->index.open(binary.cache, binary.key) &&
+			same_strings(current()->index, binary.cached->index)) {
+			binary.cached->make_paths();
+			return true;
+		}
+		binary.cached.reset();
+	}
+	object_sizes(binary.path, binary.object_sizes);
+	if (binary.object_sizes.empty() && binary.path != file)
+		object_sizes(file, binary.object_sizes);
+
+	std::vector<Dwarf_Off>& units = binary.units;
+	if (!!reader)
+		units.assign(reader->units().begin(), reader->units().end());
+	else
+		list_units(binary.dwarf->dbg(), units, binary.type_units);
+	binary.fingerprints.assign(units.size(), 0);
+	binary.statics.resize(units.size());
+	const dwarfreader *const prints = binary.dwarf->fingerprints();
+	if (_incremental && !!prints) {
+		std::vector<uint64_t>& fingerprints = binary.fingerprints;
+		std::vector<std::vector<uint64_t> >& statics = binary.statics;
+		std::vector<double> spent(units.size());
+		const bool timed = _timed;
+		for_each_unit(*prints, units, [&fingerprints, &statics, &spent,
+			timed](const dwarfreader::unit& u, size_t i) {
+			phase_timer timer(timed, spent[i]);
+			fingerprints[i] = u.fingerprint(&statics[i]);
+		});
+		for (size_t i = 0; i < spent.size(); ++i)
+			binary.fingerprinting += spent[i];
+	}
+	if (_lazy) {
+		list_files(*binary.dwarf, binary.path, *binary.inflated,
+			binary.opening, units, binary.files);
+	}
+	return true;
+}
+
+
+// Units of the binary are matched to the units parsed before by their
+// fingerprints. Units of the same fingerprint are kept and get their new
+// numbers and the new addresses of their static variables, the others
+// are dropped, and the units left are parsed (or mapped to their files in
+// the lazy mode). The index is built anew. The previous file is left in
+// 'binary'.
+void VarInfo::Imp::rebuild(Binary& binary, std::shared_ptr<snapshot>& next) {
+	// Units being loaded may read the old file till now.
+	_path = binary.path;
+	_dwarf.swap(binary.dwarf);
+	_inflated.swap(binary.inflated);
+	_stats.open += binary.opening;
+	_stats.fingerprints += binary.fingerprinting;
+	if (!!binary.cached) {
+		next = binary.cached;
+		_dwarf.reset();
+		return;
+	}
+	_object_sizes.swap(binary.object_sizes);
+	_type_units.swap(binary.type_units);
+	// Units parsed anew get the handles the strings had.
+	if (0 == _strings.size()) {
+		const varindex& index = current()->index;
+		for (size_t i = 0; i < index.strings_count(); ++i)
+			_strings.intern(index.str(i));
+	}
+
+	const std::vector<Dwarf_Off>& units = binary.units;
+	const std::vector<uint64_t>& fingerprints = binary.fingerprints;
+	// The same unit may be met in several binaries, in a few copies.
+	std::unordered_multimap<uint64_t, size_t> parsed;
+	for (size_t c = 0; c < _cu_fingerprints.size(); ++c) {
+		if (0 != _cu_fingerprints[c])
+			parsed.insert(std::make_pair(_cu_fingerprints[c], c));
+	}
+	std::vector<bool> dead(_cu_files.size(), true), kept(units.size(), false);
+	// Addresses of the same static storage follow in the same order.
+	std::map<std::pair<size_t, uint64_t>, uint64_t> moved;
+	for (size_t i = 0; i < units.size(); ++i) {
+		auto p = parsed.find(fingerprints[i]);
+		if (0 == fingerprints[i] || parsed.end() == p)
+			continue;
+		kept[i] = true;
+		dead[p->second] = false;
+		_cu_units[p->second] = i;
+		std::vector<uint64_t>& statics = _cu_statics[p->second];
+		for (size_t s = 0; s < statics.size() && s < binary.statics[i].size(); ++s) {
+			if (statics[s] != binary.statics[i][s])
+				moved[std::make_pair(p->second, statics[s])] = binary.statics[i][s];
+		}
+		statics.swap(binary.statics[i]);
+		parsed.erase(p);
+		++_stats.units_reused;
+	}
+	for (size_t v = 0; !moved.empty() && v < _vars.size(); ++v) {
+		Variable var = _vars[v];
+		auto m = moved.find(std::make_pair(var.cu(), var.address()));
+		if (moved.end() != m)
+			var.setAddress(m->second);
+	}
+	drop_units(dead);
+	// Sources of the units to parse may have changed as well.
+	_scopes.clear();
+
+	if (_lazy) {
+		_units.swap(binary.units);
+		_loaded.swap(kept);
+		map_units(binary.files);
+		next = build_index(std::string());
+		return;
+	}
+	std::vector<Dwarf_Off> changed;
+	std::vector<size_t> numbers;
+	for (size_t i = 0; i < units.size(); ++i) {
+		if (kept[i])
+			continue;
+		changed.push_back(units[i]);
+		numbers.push_back(i);
+	}
+	if (!changed.empty())
+		parse_units(_dwarf->dbg(), _dwarf->reader(), _dwarf->fingerprints(),
+			changed, numbers);
+	_dwarf.reset();
+	next = build_index(binary.key);
+	if (!binary.key.empty() && !next->index.save(binary.cache))
+		MY_PRINT("Failed to write the index to %s\n", binary.cache.c_str());
+}
+#endif // __linux
+
+
+// Finds the type at 'offset' in the unit 'cu'. A reference to the type
+// of a type unit is followed, 'cu' becomes that unit then.
+const basetype_desc *VarInfo::Imp::locate_type(size_t& cu, size_t offset) const {
+	if (is_signature_ref(offset)) {
+		const size_t i = offset & ~SIGNATURE_REF;
+		if (cu >= _cu_signatures.size() || i >= _cu_signatures[cu].size())
+			return 0;
+		auto t = _signature_types.find(_cu_signatures[cu][i]);
+		if (_signature_types.end() == t)
+			return 0;
+		cu = t->second >> 32;
+		offset = uint32_t(t->second);
+	}
+	return cu < _base_types.size() ? find_type(_base_types[cu], offset) : 0;
+}
+
+
+size_t VarInfo::Imp::type_id(const size_t cu, const size_t offset) const {
+	size_t unit = cu;
+	const basetype_desc *const t = locate_type(unit, offset);
+	return !t ? size_t(VOID_TYPE) : t->id;
+}
+
+
+// Names met in the chain of types that starts at 'offset' in the unit
+// 'cu', through type units too (@sa CU::type_names).
+void VarInfo::Imp::type_names(size_t cu, size_t offset,
+	std::vector<const char*>& names) const {
+	names.clear();
+	static const int max_refs = 256;
+	for (int i = max_refs; i > 0; --i) {
+		const basetype_desc *const t = locate_type(cu, offset);
+		if (!t)
+			break;
+		if (!t->name.empty())
+			names.push_back(t->name.c_str());
+		offset = t->next;
+	}
+}
+
+
+// Applies the type filters to the variables from 'first_var' on. Units
+// filter their variables themselves, but the ones of types of type units
+// (@sa CU::drop_unused).
+void VarInfo::Imp::filter_vars(const size_t first_var) {
+	std::vector<bool> keep(_vars.size(), true);
+	std::vector<const char*> names;
+	size_t dropped = 0;
+	for (size_t i = first_var; i < _vars.size(); ++i) {
+		Variable v = _vars[i];
+		type_names(v.cu(), v.type_offset(), names);
+		keep[i] = _filters.types.pass(names);
+		dropped += !keep[i];
+	}
+	if (0 == dropped)
+		return;
+	_vars.compact(keep);
+	_stats.filtered += dropped;
+}
+
+
+// Walks the chain of types that starts at 'offset' and makes a type
+// description of it (@sa typeinfo_desc).
+size_t VarInfo::Imp::resolve_type(const size_t cu, const size_t offset) {
+
+	typeinfo_desc info;
+	std::string suffix;
+	const std::string *name = 0;
+	size_t unit = cu;
+	size_t current_offset = offset;
+	static const int max_refs = 256;
+	int i = max_refs;
+	bool array = false;
+	do {
+		const basetype_desc *const t = locate_type(unit, current_offset);
+		if (!t) {
+			info.top = current_offset;
+			break;
+		}
+		const basetype_desc& bt = *t;
+		current_offset = bt.offset;
+		if (TK_POINTER == bt.kind || TK_REFERENCE == bt.kind) {
+			if (!(info.flags & varindex::TF_INDIRECT) && array)
+				info.flags |= varindex::TF_POINTERS;
+			info.flags |= varindex::TF_INDIRECT;
+		}
+		array = array || TK_ARRAY == bt.kind;
+		if (!info.count && bt.count)
+			info.count = bt.count;
+		if (!info.size && bt.size)
+			info.size = bt.size;
+		if (size_t(NO_TYPE) == bt.next) {
+			info.top = current_offset;
+			name = &bt.name;
+			break;
+		}
+		suffix = type_suffix(bt.kind) + suffix;
+		current_offset = bt.next;
+	} while(--i > 0);
+
+	if (0 == i) {
+		unit = cu;
+		info.top = offset;
+	} else if (!name || name->empty())
+		info.spelled = "void" + (suffix.empty() ? "*" : suffix);
+	else
+		info.spelled = *name + suffix;
+
+	auto f = _struct_fields.find(type_key(unit, info.top));
+	if (_struct_fields.end() != f)
+		info.fields = &f->second;
+
+	_types.push_back(info);
+	return _types.size() - 1;
+}
+
+
+// Resolves types of the units starting from 'first_cu' and types of
+// the variables starting from 'first_var'. Types of a unit may refer to
+// types of type units, so all the types are resolved before the fields.
+void VarInfo::Imp::resolve_types(const size_t first_cu, const size_t first_var) {
+	if (_types.empty()) {
+		_types.assign(1, typeinfo_desc());
+		_types[VOID_TYPE].spelled = "void*";
+	}
+	const size_t first_type = _types.size();
+
+	for (size_t c = first_cu; c < _base_types.size(); ++c) {
+		BaseTypesFile_t& types = _base_types[c];
+		for (auto t = types.begin(); types.end() != t; ++t)
+			t->id = resolve_type(c, t->offset);
+	}
+
+	for (size_t c = first_cu; c < _base_types.size(); ++c) {
+		const BaseTypesFile_t& types = _base_types[c];
+		for (auto t = types.begin(); types.end() != t; ++t) {
+			if (TK_STRUCTURE != t->kind &&
+				TK_CLASS != t->kind &&
+				TK_ARRAY != t->kind)
+				continue;
+			auto f = _struct_fields.find(type_key(c, t->offset));
+			if (_struct_fields.end() == f)
+				continue;
+			for (auto i = f->second.begin(); f->second.end() != i; ++i)
+				i->second.type_id = type_id(c, i->second.typeoffset);
+		}
+	}
+
+	unify_types(first_type, first_cu);
+	if (!_filters.types.empty())
+		filter_vars(first_var);
+
+	for (size_t i = first_var; i < _vars.size(); ++i) {
+		Variable v = _vars[i];
+		v.setTypeId(type_id(v.cu(), v.type_offset()));
+	}
+
+	// Only types of type units are referred to by other units.
+	for (size_t c = first_cu; c < _base_types.size(); ++c) {
+		if (!_cu_type_units[c])
+			BaseTypesFile_t().swap(_base_types[c]);
+	}
+}
+
+
+namespace {
+	size_t count_classes(const std::vector<uint64_t>& classes) {
+		return std::unordered_set<uint64_t>(classes.begin(), classes.end()).size();
+	}
+}
+
+
+// Merges the types from 'first_type' on into identical types, of the
+// same or of other units: the same spelling, size, count and flags, and
+// fields of the same names at the same offsets of identical types. Types
+// are split into classes by the hash of their own attributes, then the
+// classes are split by the classes of the types of their fields until no
+// class splits any more, so recursive types are compared too. Types of
+// the units from 'first_cu' on get the ids of the types they are merged
+// into, fields tables no type is left to use are dropped, but of type
+// units: units loaded later still resolve their types.
+void VarInfo::Imp::unify_types(const size_t first_type, const size_t first_cu) {
+	const size_t count = _types.size();
+	std::vector<uint64_t> classes(count), next(count);
+	for (size_t i = 0; i < count; ++i) {
+		const typeinfo_desc& t = _types[i];
+		uint64_t h = hash_chars(t.spelled.data(), t.spelled.size());
+		h = hash_mix(h, t.size);
+		h = hash_mix(h, t.count);
+		h = hash_mix(h, t.flags);
+		classes[i] = hash_mix(h, !t.fields ? 0 : t.fields->size() + 1);
+	}
+	for (size_t n = count_classes(classes);;) {
+		for (size_t i = 0; i < count; ++i) {
+			const typeinfo_desc& t = _types[i];
+			uint64_t h = classes[i];
+			if (!!t.fields) {
+				for (auto f = t.fields->begin(); t.fields->end() != f; ++f) {
+					h = hash_mix(h, f->first);
+					h = hash_mix(h, hash_chars(f->second.name.data(),
+						f->second.name.size()));
+					h = hash_mix(h, f->second.type_id < count ?
+						classes[f->second.type_id] : 0);
+				}
+			}
+			next[i] = h;
+		}
+		classes.swap(next);
+		const size_t split = count_classes(classes);
+		if (split == n)
+			break;
+		n = split;
+	}
+
+	// Types resolved before are all different, they keep their ids.
+	std::vector<size_t> ids(count);
+	std::unordered_map<uint64_t, size_t> kept;
+	size_t last = first_type;
+	for (size_t i = 0; i < count; ++i) {
+		auto k = kept.insert(std::make_pair(classes[i], i < first_type ? i : last));
+		if (i < first_type)
+			ids[i] = i;
+		else if (!k.second)
+			ids[i] = k.first->second;
+		else {
+			if (last != i)
+				_types[last] = std::move(_types[i]);
+			ids[i] = last++;
+		}
+	}
+	_stats.types_merged += count - last;
+	_types.resize(last);
+
+	std::unordered_set<const FieldsNames_t*> used;
+	for (size_t i = first_type; i < last; ++i)
+		used.insert(_types[i].fields);
+	for (auto s = _struct_fields.begin(); _struct_fields.end() != s;) {
+		const size_t cu = s->first >> 32;
+		if (cu < first_cu) {
+			++s;
+		} else if (!used.count(&s->second) && !_cu_type_units[cu]) {
+			s = _struct_fields.erase(s);
+		} else {
+			for (auto f = s->second.begin(); s->second.end() != f; ++f)
+				f->second.type_id = ids[f->second.type_id];
+			++s;
+		}
+	}
+	for (size_t c = first_cu; c < _base_types.size(); ++c) {
+		BaseTypesFile_t& types = _base_types[c];
+		for (auto t = types.begin(); types.end() != t; ++t)
+			t->id = ids[t->id];
+	}
+}
+
+
+// Drops the units marked in 'dead' by CU id with their variables, and
+// the types and fields tables only they used. Types and units left keep
+// their order but not their ids.
+void VarInfo::Imp::drop_units(const std::vector<bool>& dead) {
+	std::vector<bool> keep(_vars.size());
+	for (size_t i = 0; i < _vars.size(); ++i)
+		keep[i] = !dead[_vars[i].cu()];
+	_vars.compact(keep);
+	for (size_t c = 0; c < dead.size(); ++c) {
+		if (!dead[c])
+			continue;
+		_cu_fingerprints[c] = 0;
+		std::vector<uint64_t>().swap(_cu_statics[c]);
+		_cu_type_units[c] = false;
+		BaseTypesFile_t().swap(_base_types[c]);
+		std::vector<uint64_t>().swap(_cu_signatures[c]);
+	}
+	for (auto s = _signature_types.begin(); _signature_types.end() != s;) {
+		if (dead[s->second >> 32])
+			s = _signature_types.erase(s);
+		else
+			++s;
+	}
+
+	// Types are used by the variables, by fields and by type units,
+	// which types other units may use.
+	std::vector<bool> used(_types.size(), false);
+	std::vector<size_t> stack;
+	auto use = [&used, &stack](const size_t id) {
+		if (id < used.size() && !used[id]) {
+			used[id] = true;
+			stack.push_back(id);
+		}
+	};
+	use(VOID_TYPE);
+	for (size_t i = 0; i < _vars.size(); ++i)
+		use(_vars[i].typeinfo_id());
+	for (size_t c = 0; c < _base_types.size(); ++c) {
+		for (auto t = _base_types[c].begin(); _base_types[c].end() != t; ++t)
+			use(t->id);
+	}
+	for (auto s = _struct_fields.begin(); _struct_fields.end() != s; ++s) {
+		if (!_cu_type_units[s->first >> 32])
+			continue;
+		for (auto f = s->second.begin(); s->second.end() != f; ++f)
+			use(f->second.type_id);
+	}
+	while (!stack.empty()) {
+		const typeinfo_desc& t = _types[stack.back()];
+		stack.pop_back();
+		if (!t.fields)
+			continue;
+		for (auto f = t.fields->begin(); t.fields->end() != f; ++f)
+			use(f->second.type_id);
+	}
+
+	std::vector<size_t> ids(_types.size(), size_t(VOID_TYPE));
+	size_t last = 0;
+	for (size_t i = 0; i < _types.size(); ++i) {
+		if (!used[i])
+			continue;
+		if (last != i)
+			_types[last] = std::move(_types[i]);
+		ids[i] = last++;
+	}
+	_types.resize(last);
+	for (size_t i = 0; i < _vars.size(); ++i) {
+		Variable v = _vars[i];
+		v.setTypeId(ids[v.typeinfo_id()]);
+	}
+	for (size_t c = 0; c < _base_types.size(); ++c) {
+		for (auto t = _base_types[c].begin(); _base_types[c].end() != t; ++t)
+			t->id = ids[t->id];
+	}
+	std::unordered_set<const FieldsNames_t*> tables;
+	for (auto t = _types.begin(); _types.end() != t; ++t)
+		tables.insert(t->fields);
+	for (auto s = _struct_fields.begin(); _struct_fields.end() != s;) {
+		if (!tables.count(&s->second) && !_cu_type_units[s->first >> 32]) {
+			s = _struct_fields.erase(s);
+			continue;
+		}
+		for (auto f = s->second.begin(); s->second.end() != f; ++f)
+			f->second.type_id = ids[f->second.type_id];
+		++s;
+	}
+
+	// Units parsed later follow the ones left.
+	std::vector<size_t> cus(dead.size(), 0);
+	size_t live = 0;
+	for (size_t c = 0; c < dead.size(); ++c) {
+		if (dead[c])
+			continue;
+		if (live != c) {
+			_cu_files[live].swap(_cu_files[c]);
+			_cu_units[live] = _cu_units[c];
+			_cu_fingerprints[live] = _cu_fingerprints[c];
+			_cu_statics[live].swap(_cu_statics[c]);
+			_cu_type_units[live] = _cu_type_units[c];
+			_base_types[live].swap(_base_types[c]);
+			_cu_signatures[live].swap(_cu_signatures[c]);
+		}
+		cus[c] = live++;
+	}
+	if (live == dead.size())
+		return;
+	_cu_files.resize(live);
+	_cu_units.resize(live);
+	_cu_fingerprints.resize(live);
+	_cu_statics.resize(live);
+	_cu_type_units.resize(live);
+	_base_types.resize(live);
+	_cu_signatures.resize(live);
+	_vars.renumber_units(cus);
+	for (auto s = _signature_types.begin(); _signature_types.end() != s; ++s)
+		s->second = type_key(cus[s->second >> 32], uint32_t(s->second));
+	// Fields tables are keyed by the unit, the types refer to them.
+	StructFields_t fields;
+	std::unordered_map<const FieldsNames_t*, const FieldsNames_t*> moved;
+	for (auto s = _struct_fields.begin(); _struct_fields.end() != s; ++s) {
+		FieldsNames_t& f = fields[type_key(cus[s->first >> 32], uint32_t(s->first))];
+		f.swap(s->second);
+		moved[&s->second] = &f;
+	}
+	_struct_fields.swap(fields);
+	for (auto t = _types.begin(); _types.end() != t; ++t) {
+		if (!!t->fields)
+			t->fields = moved[t->fields];
+	}
+}
+
+
+std::shared_ptr<snapshot> VarInfo::Imp::build_index(const std::string& key) {
+	phase_timer timer(_timed, _stats.index);
+	varindex::builder index;
+
+	// Handles are ids of the strings table, they stay the same while
+	// units are loaded in the lazy mode. Types and fields names are
+	// interned too, as they are handles of the results.
+	for (auto t = _types.begin(); _types.end() != t; ++t)
+		_strings.intern(t->spelled);
+	for (auto s = _struct_fields.begin(); _struct_fields.end() != s; ++s) {
+		for (auto f = s->second.begin(); s->second.end() != f; ++f)
+			_strings.intern(f->second.name);
+	}
+	for (size_t i = 0; i < _strings.size(); ++i)
+		index.intern(_strings.str(i));
+
+	// Variables follow in the order of their units in .debug_info
+	// whatever order the units are loaded in.
+	std::vector<size_t> order(_vars.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [this](size_t l, size_t r) {
+		return _cu_units[_vars[l].cu()] < _cu_units[_vars[r].cu()];
+	});
+
+	std::vector<varindex::range_t> unsorted(_vars.size());
+	for (size_t i = 0; i < _vars.size(); ++i) {
+		const Variable var = _vars[order[i]];
+		unsorted[i].file = var.file_id();
+		unsorted[i].name = var.name_id();
+		unsorted[i].line = index_line(var.line());
+		unsorted[i].vis_end = index_line(var.visEndsLine());
+		unsorted[i].type = var.typeinfo_id();
+	}
+	// Stable to keep the latest of the declarations made on the same line
+	// the innermost one.
+	std::vector<size_t> sorted(unsorted.size());
+	for (size_t i = 0; i < sorted.size(); ++i)
+		sorted[i] = i;
+	std::stable_sort(sorted.begin(), sorted.end(), [&unsorted](size_t l, size_t r) {
+		return unsorted[l] < unsorted[r];
+	});
+	std::vector<varindex::range_t>& ranges = index.ranges;
+	ranges.resize(unsorted.size());
+	for (size_t i = 0; i < sorted.size(); ++i)
+		ranges[i] = unsorted[sorted[i]];
+	std::vector<varindex::range_t>().swap(unsorted);
+
+	// Sizes of variables are taken from the symbol table, from the type
+	// if there is no symbol (the array count is the upper bound).
+	std::vector<varindex::symbol_t>& symbols = index.symbols;
+	for (size_t i = 0; i < sorted.size(); ++i) {
+		const Variable var = _vars[order[sorted[i]]];
+		if (Variable::NO_ADDRESS == var.address())
+			continue;
+		varindex::symbol_t symbol;
+		symbol.address = var.address();
+		auto size = _object_sizes.find(symbol.address);
+		const typeinfo_desc& t = var.typeinfo();
+		symbol.size = _object_sizes.end() != size ? size->second :
+			t.count ? t.size * (t.count + 1) : t.size;
+		symbol.size = std::max<uint64_t>(symbol.size, 1);
+		symbol.range = i;
+		symbol.reserved = 0;
+		symbols.push_back(symbol);
+	}
+	// Variables defined in several units (inline, templates) are merged
+	// by the linker, the first declaration is kept.
+	std::stable_sort(symbols.begin(), symbols.end(),
+		[](const varindex::symbol_t& l, const varindex::symbol_t& r) {
+		return l.address < r.address;
+	});
+	symbols.erase(std::unique(symbols.begin(), symbols.end(),
+		[](const varindex::symbol_t& l, const varindex::symbol_t& r) {
+		return l.address == r.address;
+	}), symbols.end());
+
+	// Ranges that end before the current declaration line can't enclose
+	// it or any of the following declarations of the same name.
+	std::vector<uint32_t> open;
+	for (size_t i = 0; i < ranges.size(); ++i) {
+		varindex::range_t& r = ranges[i];
+		if (0 != i && !same_var(ranges[i - 1], r))
+			open.clear();
+		while (!open.empty() && ranges[open.back()].vis_end < r.line)
+			open.pop_back();
+		r.enclosing = open.empty() ? uint32_t(varindex::NONE) : open.back();
+		open.push_back(i);
+	}
+
+	// Types sharing the top type share its fields.
+	std::map<const FieldsNames_t*, std::pair<uint32_t, uint32_t> > fields;
+	index.types.resize(_types.size());
+	for (size_t i = 0; i < _types.size(); ++i) {
+		const typeinfo_desc& t = _types[i];
+		varindex::type_t& it = index.types[i];
+		it.spelled = index.intern(t.spelled);
+		it.size = t.size;
+		it.count = t.count;
+		it.flags = t.flags;
+		it.fields = 0;
+		it.nfields = 0;
+		if (!t.fields)
+			continue;
+		auto f = fields.find(t.fields);
+		if (fields.end() == f) {
+			const uint32_t first = index.fields.size();
+			for (auto j = t.fields->begin(); t.fields->end() != j; ++j) {
+				varindex::field_t field;
+				field.offset = j->first;
+				field.name = index.intern(j->second.name);
+				field.type = j->second.type_id;
+				index.fields.push_back(field);
+			}
+			f = fields.insert(std::make_pair(t.fields, std::make_pair(first,
+				uint32_t(index.fields.size() - first)))).first;
+		}
+		it.fields = f->second.first;
+		it.nfields = f->second.second;
+	}
+
+	std::shared_ptr<snapshot> next(new snapshot);
+	next->index.build(index, key);
+	next->make_paths();
+	count_tables();
+	if (_lazy)
+		return next;
+
+	// Only the index is used from now on, but reload() patches the
+	// parsing results if they are kept.
+#ifdef __linux
+	_scopes.clear();
+#endif // __linux
+	std::unordered_map<uint64_t, uint64_t>().swap(_object_sizes);
+	if (_incremental)
+		return next;
+	_vars.clear();
+	Strings().swap(_strings);
+	BaseTypes_t().swap(_base_types);
+	Types_t().swap(_types);
+	std::vector<std::string>().swap(_cu_files);
+	std::vector<size_t>().swap(_cu_units);
+	std::vector<uint64_t>().swap(_cu_fingerprints);
+	std::vector<std::vector<uint64_t> >().swap(_cu_statics);
+	std::vector<std::vector<uint64_t> >().swap(_cu_signatures);
+	std::vector<bool>().swap(_cu_type_units);
+	std::unordered_map<uint64_t, uint64_t>().swap(_signature_types);
+	StructFields_t().swap(_struct_fields);
+	return next;
+}
+
+
+// Counts the parsing results the index is built of (@sa VarInfo::Stats).
+void VarInfo::Imp::count_tables() {
+	_stats.variables = _vars.size();
+	_stats.types = _types.size();
+	_stats.strings_bytes = _strings.bytes();
+	_stats.variables_bytes = _vars.bytes();
+	// Nodes of the maps are taken for two pointers more than their values.
+	const size_t node = 2 * sizeof(void*);
+	size_t types = _types.capacity() * sizeof(typeinfo_desc);
+	for (auto t = _types.begin(); _types.end() != t; ++t)
+		types += t->spelled.capacity();
+	for (auto b = _base_types.begin(); _base_types.end() != b; ++b)
+		types += b->size() * sizeof(basetype_desc);
+	_stats.types_bytes = types;
+	size_t fields = 0, fields_bytes = 0;
+	for (auto s = _struct_fields.begin(); _struct_fields.end() != s; ++s) {
+		fields += s->second.size();
+		fields_bytes += sizeof(StructFields_t::value_type) + node;
+		for (auto f = s->second.begin(); s->second.end() != f; ++f) {
+			fields_bytes += sizeof(FieldsNames_t::value_type) + 2 * node +
+				f->second.name.capacity();
+		}
+	}
+	_stats.fields = fields;
+	_stats.fields_bytes = fields_bytes;
+}
+
+
+namespace {
+	// Builds the table of the fields of the type on the first use. Threads
+	// racing for the same table may build it each, the first one is kept.
+	const FieldPaths& snapshot::field_paths(const varindex::type_t& t) const {
+		std::atomic<const FieldPaths*>& slot = _paths[t.fields];
+		const FieldPaths *paths = slot.load(std::memory_order_acquire);
+		if (!!paths)
+			return *paths;
+
+		std::unique_ptr<FieldPaths> built(new FieldPaths);
+		flatten(t, 0, std::string(), *built, 0);
+		std::vector<field_path_t>& entries = built->entries;
+		std::stable_sort(entries.begin(), entries.end(),
+			[](const field_path_t& l, const field_path_t& r) { return l.begin < r.begin; });
+		// Fields sharing bytes (bit fields) give them to the following one.
+		for (size_t i = 1; i < entries.size(); ++i)
+			entries[i - 1].end = std::min(entries[i - 1].end, entries[i].begin);
+
+		if (slot.compare_exchange_strong(paths, built.get(),
+			std::memory_order_acq_rel, std::memory_order_acquire))
+			return *built.release();
+		return *paths;
+	}
+
+
+	// Adds the fields of the type placed at 'base' to the table. Fields of
+	// nested structures are added in place, and the bytes of a nested
+	// structure not covered by its fields belong to the structure itself.
+	void snapshot::flatten(const varindex::type_t& t, const uint32_t base,
+		const std::string& prefix, FieldPaths& paths, const int depth) const {
+
+		for (auto f = index.fields_begin(t); index.fields_end(t) != f; ++f) {
+			const varindex::type_t& ft = index.type(f->type);
+			const std::string path = prefix + index.str(f->name);
+			const uint64_t size = std::max<uint64_t>(ft.size, 1);
+			field_path_t entry;
+			entry.begin = base + f->offset;
+			entry.end = std::min<uint64_t>(entry.begin +
+				(is_array(ft) ? size * (ft.count + 1) : size), UINT32_MAX);
+			entry.type = f->type;
+			entry.field = f->name;
+			entry.path = paths.text.size();
+			entry.path_size = path.size();
+			entry.array = is_array(ft);
+			paths.text += path;
+
+			const size_t first = paths.entries.size();
+			if (!entry.array && !(ft.flags & varindex::TF_INDIRECT) &&
+				0 != ft.nfields && depth < MAX_NESTING)
+				flatten(ft, entry.begin, path + '.', paths, depth + 1);
+			if (first == paths.entries.size()) {
+				paths.entries.push_back(entry);
+				continue;
+			}
+			// Bytes not covered by the fields of the nested structure.
+			const size_t last = paths.entries.size();
+			std::sort(paths.entries.begin() + first, paths.entries.end(),
+				[](const field_path_t& l, const field_path_t& r) { return l.begin < r.begin; });
+			uint32_t covered = entry.begin;
+			for (size_t i = first; i <= last; ++i) {
+				const uint32_t next = i < last ? paths.entries[i].begin : entry.end;
+				if (covered < next) {
+					field_path_t gap = entry;
+					gap.begin = covered;
+					gap.end = next;
+					paths.entries.push_back(gap);
+				}
+				if (i < last)
+					covered = std::max(covered, paths.entries[i].end);
+			}
+		}
+	}
+
+
+	// Goes through the queries in (file, name, line, offset) order, so that
+	// the declarations of a variable are looked up once for all its queries,
+	// and the same queries share the answer.
+	void snapshot::resolve(const VarInfo::Query *queries,
+		const size_t count, VarInfo::Result *results) const {
+
+		std::vector<size_t> order(count);
+		for (size_t i = 0; i < count; ++i)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [queries](size_t l, size_t r) {
+			const VarInfo::Query& a = queries[l];
+			const VarInfo::Query& b = queries[r];
+			if (a.file != b.file)
+				return a.file < b.file;
+			if (a.name != b.name)
+				return a.name < b.name;
+			if (a.line != b.line)
+				return a.line < b.line;
+			return a.offset < b.offset;
+		});
+
+		const varindex::range_t *first = 0, *last = 0, *var = 0;
+		const VarInfo::Query *prev = 0;
+		for (size_t i = 0; i < count; ++i) {
+			const VarInfo::Query& q = queries[order[i]];
+			VarInfo::Result& result = results[order[i]];
+			const bool same_name = !!prev && prev->file == q.file &&
+				prev->name == q.name;
+			if (!same_name)
+				get_ranges(q.file, q.name, first, last);
+			if (!same_name || prev->line != q.line)
+				var = get_var(first, last, q.line);
+			else if (prev->offset == q.offset) {
+				result = results[order[i - 1]];
+				continue;
+			}
+			resolve(var, q.offset, result);
+			prev = &q;
+		}
+	}
+}
+
+
+// Queries of a batch are split into slices of at least this size
+// per thread.
+enum {MIN_SLICE = 4096};
+
+
+// All the slices are answered by the same snapshot.
+void VarInfo::Imp::resolve(const VarInfo::Query *queries, const size_t count,
+	VarInfo::Result *results, unsigned threads) const {
+
+	std::shared_ptr<const snapshot> snap = current();
+	if (_lazy) {
+		std::vector<VarInfo::handle_t> files(count);
+		for (size_t i = 0; i < count; ++i)
+			files[i] = queries[i].file;
+		std::sort(files.begin(), files.end());
+		files.erase(std::unique(files.begin(), files.end()), files.end());
+		// The last snapshot has the units of all the files unless a reload
+		// has mapped the files anew meanwhile, then they are loaded again.
+		for (bool mapped = false; !mapped;) {
+			mapped = true;
+			for (auto f = files.begin(); files.end() != f; ++f) {
+				std::shared_ptr<const snapshot> s = current(*f);
+				mapped = mapped && (files.begin() == f || s->files == snap->files);
+				snap.swap(s);
+			}
+		}
+	}
+
+	if (0 == threads)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	const size_t slices = std::max<size_t>(1,
+		std::min<size_t>(threads, count / MIN_SLICE));
+	std::vector<std::thread> workers;
+	for (size_t s = 1; s < slices; ++s) {
+		const size_t begin = count * s / slices;
+		const size_t end = count * (s + 1) / slices;
+		workers.push_back(std::thread([&snap, queries, results, begin, end]() {
+			snap->resolve(queries + begin, end - begin, results + begin);
+		}));
+	}
+	snap->resolve(queries, count / slices, results);
+	for (auto w = workers.begin(); workers.end() != w; ++w)
+		w->join();
+}
+
+
+// Fills in the statistics of the snapshot and makes it the one queries
+// start with. Queries running keep the snapshot they hold, the last of
+// them frees it.
+void VarInfo::Imp::publish(const std::shared_ptr<snapshot>& next) {
+	next->generation = _generation;
+#ifdef __linux
+	next->files = _files;
+#endif // __linux
+	VarInfo::Stats& stats = next->stats;
+	stats = _stats;
+	stats.index_bytes = next->index.size();
+	if (0 != stats.types)
+		stats.dedup_ratio = double(stats.types + stats.types_merged) / stats.types;
+#ifdef __linux
+	const scoping::cache::stats_t scopes = _scopes.stats();
+	stats.sources = scopes.files;
+	stats.source_bytes = scopes.bytes;
+	// Sources are read while walking DIEs of the units.
+	stats.scoping = _timed ? scopes.seconds : 0;
+	stats.dies = std::max(0.0, stats.dies - stats.scoping);
+	stats.scopes_bytes = scopes.scopes *
+		(sizeof(scoping::scope_t::value_type) + 4 * sizeof(void*));
+	if (!!_inflated) {
+		stats.compressed_bytes = _inflated->compressed();
+		stats.decompressed_bytes = _inflated->decompressed();
+		// Sections are inflated while opening the file.
+		stats.decompress = _timed ? _inflated->seconds() : 0;
+		stats.open = std::max(0.0, stats.open - stats.decompress);
+	}
+#endif // __linux
+	std::atomic_store(&_snapshot, std::shared_ptr<const snapshot>(next));
+}
+
+
 VarInfo::VarInfo() : _imp(new VarInfo::Imp) {}
 
+VarInfo::~VarInfo() {}
+
+VarInfo::VarInfo(VarInfo&& other) : _file(std::move(other._file)),
+	_imp(std::move(other._imp)) {}
+
+VarInfo& VarInfo::operator=(VarInfo&& other) {
+	_file = std::move(other._file);
+	_imp = std::move(other._imp);
+	return *this;
+}
+
 const std::string VarInfo::type(const std::string& file, const size_t line, const std::string& name) const {
 	return _imp->type(file, line, name);
 }
@@ -929,7 +3943,51 @@ const std::string VarInfo::fieldname(const std::string& file, const size_t line,
 	return _imp->fieldname(file, line, name, offset);
 }
 
+VarInfo::handle_t VarInfo::file_handle(const std::string& file) const {
+	return _imp->file_handle(file);
+}
+
+VarInfo::handle_t VarInfo::name_handle(const std::string& name) const {
+	return _imp->name_handle(name);
+}
+
+const std::string VarInfo::type(const handle_t file, const size_t line, const handle_t name) const {
+	return _imp->type(file, line, name);
+}
+
+const std::string VarInfo::fieldname(const handle_t file, const size_t line, const handle_t name, const unsigned offset) const {
+	return _imp->fieldname(file, line, name, offset);
+}
+
+void VarInfo::resolve(const Query *queries, const size_t count, Result *results, const unsigned threads) const {
+	_imp->resolve(queries, count, results, threads);
+}
+
+bool VarInfo::symbolize(const uint64_t address, Symbol& symbol) const {
+	return _imp->symbolize(address, symbol);
+}
+
+const std::string VarInfo::text(const handle_t handle) const {
+	return _imp->text(handle);
+}
+
+const std::string VarInfo::result_fieldname(const Result& result) const {
+	return _imp->result_fieldname(result);
+}
+
+VarInfo::Stats VarInfo::stats() const {
+	return _imp->stats();
+}
+
 bool VarInfo::init(const std::string& file) {
+	return init(file, Options());
+}
+
+bool VarInfo::init(const std::string& file, const Options& options) {
 	_file = file;
-	return _imp->init(_file);
+	return _imp->init(_file, options);
+}
+
+bool VarInfo::reload() {
+	return _imp->reload(_file);
 }
@@ -9,22 +9,198 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include <memory>
 #include "varinfo_i.hpp"
 
 
+/// Once init() returns, the data base is read only: any number of threads
+/// may query the same VarInfo at once, without locks. reload() builds the
+/// next data base aside and swaps it in, queries started before finish on
+/// the previous one. In the lazy mode the queries which parse units or
+/// give out handles to names not indexed yet take a lock, the others
+/// don't.
 class VarInfo : public IVarInfo {
 public:
+	/// \!brief Options of the data base construction.
+	struct Options {
+		Options() : threads(1), debug_dir("/usr/lib/debug"), lazy(false),
+			native(false), incremental(false), stats(false) {};
+
+		/// Number of threads parsing compilation units in parallel,
+		/// 0 - one per CPU core. The result doesn't depend on it.
+		unsigned threads;
+
+		/// Global directory of separate debug files. DWARF of a stripped
+		/// binary is read from its debug file, found by the build id in
+		/// 'debug_dir'/.build-id/ or by its .gnu_debuglink next to the
+		/// binary, in its .debug/ or under 'debug_dir'. The binary itself
+		/// then only identifies the debug file.
+		std::string debug_dir;
+
+		/// Directory to keep built data bases in, empty - don't keep.
+		/// A data base kept for the same binary (by its build id, or by
+		/// its path, size and modification time) is used as is, without
+		/// parsing. Stale or broken ones are rebuilt.
+		std::string cache_dir;
+
+		/// Parse a compilation unit only when a query touches one of
+		/// its source files. init() then only lists the source files of
+		/// the units. Handles of names are given out for any name.
+		bool lazy;
+
+		/// Read DWARF 2-5 with the built-in reader rather than libdwarf:
+		/// it decodes the mapped sections in place and is shared by the
+		/// threads. Files it can't read are read by libdwarf. The results
+		/// are the same.
+		bool native;
+
+		/// Keep the parsing results and the fingerprints of the units for
+		/// reload() to parse only the units that changed. Takes the memory
+		/// of the parsing results, which are dropped otherwise once the
+		/// index is built. The lazy mode keeps them anyway.
+		bool incremental;
+
+		/// Globs (fnmatch(3), '*' matches '/' too) of the source files to
+		/// index variables of, by DW_AT_decl_file, e.g. "/home/me/src/*":
+		/// a file is indexed if it matches some include glob, or there
+		/// are none, and no exclude glob. Functions of other files are
+		/// skipped with all their DIEs.
+		std::vector<std::string> include_files;
+		std::vector<std::string> exclude_files;
+
+		/// Same by the names of the types of the variables: a variable is
+		/// indexed if its type or one of the typedefs it goes through
+		/// matches some include glob, or there are none, and none of them
+		/// matches an exclude glob. Types the indexed variables use are
+		/// kept whatever their names and files, others are dropped.
+		std::vector<std::string> include_types;
+		std::vector<std::string> exclude_types;
+
+		/// Time the phases of init() (@sa Stats), the counters are
+		/// collected anyway.
+		bool stats;
+	};
+
+	/// \!brief Statistics of the data base construction, in the lazy mode
+	/// they add up over the units loaded so far. reload() starts them anew.
+	struct Stats {
+		Stats() : open(0), lines(0), dies(0), scoping(0), decompress(0),
+			fingerprints(0), index(0), total(0), compressed_bytes(0),
+			decompressed_bytes(0), units(0), units_reused(0),
+			dies_visited(0), dies_skipped(0), filtered(0),
+			variables(0), types(0), types_merged(0), dedup_ratio(1),
+			fields(0), sources(0), source_bytes(0), strings_bytes(0),
+			variables_bytes(0), types_bytes(0), fields_bytes(0),
+			scopes_bytes(0), index_bytes(0) {};
+
+		/// Seconds spent in the phases if Options::stats is set. Phases
+		/// run by several threads are summed over the threads.
+		double open;		// opening ELF and DWARF of the binary
+		double lines;		// line tables pass
+		double dies;		// DIEs walk, without scoping
+		double scoping;		// reading and parsing the sources
+		double decompress;	// inflating compressed debug sections
+		double fingerprints;	// of the units (@sa Options::incremental)
+		double index;		// building the index
+		double total;		// wall time of init() and of the lazy loads
+
+		/// Compressed (-gz) debug sections, before and after inflating.
+		size_t compressed_bytes;
+		size_t decompressed_bytes;
+
+		size_t units;			// parsed
+		size_t units_reused;	// unchanged ones reload() kept
+		size_t dies_visited;
+		size_t dies_skipped;	// not of interest, their children aren't visited
+		size_t filtered;		// variables and functions left out by the globs
+		size_t variables;
+		size_t types;
+		size_t types_merged;	// into identical types, of other units mostly
+		double dedup_ratio;		// types parsed per type kept, 1 - no duplicates
+		size_t fields;			// of structures and classes
+		size_t sources;			// source files scanned for scopes
+		size_t source_bytes;
+
+		/// Approximate memory taken by the tables when the index is built.
+		size_t strings_bytes;
+		size_t variables_bytes;
+		size_t types_bytes;
+		size_t fields_bytes;
+		size_t scopes_bytes;
+		size_t index_bytes;
+	};
+
 	VarInfo();
+	~VarInfo();
+
+	/// A moved from VarInfo may only be destroyed or assigned to.
+	VarInfo(VarInfo&& other);
+	VarInfo& operator=(VarInfo&& other);
 
 	/// \!brief Constructs variables data base by a binary file.
 	bool init(const std::string& file);
 
+	bool init(const std::string& file, const Options& options);
+
+	/// \!brief Re-indexes the binary given to init() once it is rebuilt, with
+	/// the same options. Units are matched to the ones parsed before by
+	/// their fingerprints: unchanged ones are kept, changed and new ones
+	/// are parsed (all of them unless the parsing results are kept, @sa
+	/// Options::incremental). Units are fingerprinted by the built-in
+	/// reader, units of files it can't read are all parsed again. May run
+	/// in a thread of its own while others query, one reload() at a time.
+	/// Queries of the lazy mode which load units wait only while the units
+	/// read replace the ones loaded, not while the binary is read and
+	/// fingerprinted.
+	/// Handles stay valid: strings keep their handles, the strings of the
+	/// units dropped are kept too. Results of resolve() and symbolize()
+	/// made before keep their strings, result_fieldname() of them is
+	/// "<Unknown>".
+	bool reload();
+
 	/// \!brief Returns variable base type given its occurence in the file and its name.
 	const std::string type(const std::string& file, const size_t line, const std::string& name) const;
 
+	/// \!brief Returns the path of the field at the offset in the variable, through
+	/// nested structures and arrays, e.g. "hdr.flags" or "slots[3].key".
 	const std::string fieldname(const std::string& file, const size_t line, const std::string& name, const unsigned offset) const;
 
+	/// \!brief Resolves a source file path to a handle for the queries below,
+	/// returns NO_HANDLE if no variable is declared in the file.
+	handle_t file_handle(const std::string& file) const;
+
+	/// \!brief Resolves a variable name to a handle for the queries below,
+	/// returns NO_HANDLE if there is no variable with such name.
+	handle_t name_handle(const std::string& name) const;
+
+	/// \!brief Same as above but the file and the name are pre-resolved,
+	/// so repeated queries don't pay for strings hashing.
+	const std::string type(const handle_t file, const size_t line, const handle_t name) const;
+
+	const std::string fieldname(const handle_t file, const size_t line, const handle_t name, const unsigned offset) const;
+
+	/// \!brief Answers a batch of queries (@sa IVarInfo::Query). Queries of
+	/// the same variable share its lookup, large batches are split among
+	/// 'threads' threads.
+	void resolve(const Query *queries, const size_t count, Result *results, const unsigned threads = 1) const;
+
+	/// \!brief Finds a global or static variable by an address in the data
+	/// of the binary (e.g. a sampled memory access). Addresses come from
+	/// DWARF locations and sizes from the symbol table. In the lazy mode
+	/// only the variables of loaded units are found.
+	bool symbolize(const uint64_t address, Symbol& symbol) const;
+
+	/// \!brief Returns the string of a handle, e.g. of a result.
+	const std::string text(const handle_t handle) const;
+
+	/// \!brief Returns the path of the field of a result, same as fieldname(),
+	/// "<Unknown>" for a result of the data base before the last reload().
+	const std::string result_fieldname(const Result& result) const;
+
+	/// \!brief Returns statistics of the data base construction.
+	Stats stats() const;
+
 private:
 	VarInfo(const VarInfo&);
 	VarInfo& operator=(const VarInfo&);
@@ -32,6 +208,6 @@ private:
 private:
 	std::string _file;
 
-	class Imp;	
-	const std::auto_ptr<Imp> _imp;
+	class Imp;
+	std::unique_ptr<Imp> _imp;
 };
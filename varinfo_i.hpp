@@ -4,15 +4,69 @@
 ///
 #pragma once
 
+#include <stdint.h>
 #include <string>
 
 
 class IVarInfo {
 public:
+	/// Pre-resolved source file path or variable name.
+	typedef unsigned handle_t;
+	static const handle_t NO_HANDLE = ~0u;
+
 	virtual bool init(const std::string& file) = 0;
 	virtual const std::string type(const std::string& file, const size_t line, const std::string& name) const = 0;
 	virtual const std::string fieldname(const std::string&, const size_t, const std::string&, const unsigned) const = 0;
 
+	virtual handle_t file_handle(const std::string& file) const = 0;
+	virtual handle_t name_handle(const std::string& name) const = 0;
+	virtual const std::string type(const handle_t file, const size_t line, const handle_t name) const = 0;
+	virtual const std::string fieldname(const handle_t, const size_t, const handle_t, const unsigned) const = 0;
+
+	/// Query of the batch API, same as the arguments of fieldname().
+	struct Query {
+		handle_t file;
+		size_t line;
+		handle_t name;
+		unsigned offset;
+	};
+
+	/// Answer to a query. 'type' and 'field' are handles of the spelled
+	/// type of the variable and of the innermost field at the offset,
+	/// NO_HANDLE if unknown. The full path of the field is given by
+	/// result_fieldname().
+	struct Result {
+		handle_t type;
+		handle_t field;
+		unsigned var_type;	// where the path is looked up
+		unsigned offset;
+		unsigned generation;	// of the data base that answered
+	};
+
+	/// Answers 'count' queries at once, results[i] answers queries[i].
+	/// 'threads' - 0 for one per CPU core.
+	virtual void resolve(const Query *queries, const size_t count, Result *results, const unsigned threads = 1) const = 0;
+	virtual const std::string text(const handle_t handle) const = 0;
+
+	/// Variable of static storage (global or static) found by a data
+	/// address, 'result' tells the field at the offset of the address.
+	struct Symbol {
+		handle_t file;
+		size_t line;
+		handle_t name;
+		uint64_t offset;
+		Result result;
+	};
+
+	/// Looks up the variable the address belongs to, false if none.
+	virtual bool symbolize(const uint64_t address, Symbol& symbol) const = 0;
+
+	/// Same strings as type() and fieldname() return.
+	const std::string result_type(const Result& r) const {
+		return NO_HANDLE == r.type ? "<Unknown>" : text(r.type);
+	}
+	virtual const std::string result_fieldname(const Result& r) const = 0;
+
 protected:
 	virtual ~IVarInfo() {};
 };